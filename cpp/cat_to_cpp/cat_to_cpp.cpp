@@ -4,9 +4,22 @@
 
 #define _CRT_SECURE_NO_DEPRECATE
 
+#include <ctime>
+#include <cstring>
+
 #include "..\yard\yard.hpp"
 #include "..\ootl\ootl_stack.hpp"
 #include "..\ootl\ootl_hash.hpp"
+#include "..\ootl\ootl_string.hpp"
+#include "..\ootl\ootl_symbol.hpp"
+#include "..\ootl\ootl_mapped_hash.hpp"
+
+// the concurrent containers need C++11 atomics and threads
+#ifdef OOTL_HAS_MOVE
+#include <thread>
+#include "..\ootl\ootl_concurrent_vlist.hpp"
+#include "..\ootl\ootl_concurrent_hash.hpp"
+#endif
 
 #include "cat_grammar.hpp"
 
@@ -18,38 +31,39 @@ typedef CatParser::Iterator Iterator;
 
 ootl::hash_map<Node*, int> anon_fxns;
 
-void printch(char c)
+// appends the C++ spelling of a character of a Cat name
+void MangleChar(char c, ootl::string& s)
 {
 	switch (c)
 	{
-		case '_' : printf("__"); break;
-		case '~': printf("_tilde_"); break;
-		case '`': printf("_backquote_"); break;
-		case '!': printf("_exclaim_"); break;
-		case '@': printf("_apos_"); break;
-		case '#': printf("_hash_"); break;
-		case '$': printf("_dollar_"); break;
-		case '%': printf("_percent_"); break;
-		case '^': printf("_caret_"); break;
-		case '&': printf("_amp_"); break;
-		case '*': printf("_star_"); break;
-		case '(': printf("_lparan_"); break;
-		case ')': printf("_rparan_"); break;
-		case '-': printf("_minus_"); break;
-		case '+': printf("_plus_"); break;
-		case '=': printf("_eq_"); break;
-		case '|': printf("_pipe_"); break;
-		case '\\': printf("_bslash_"); break;
-		case ':': printf("_colon_"); break;
-		case '<': printf("_lt_"); break;
-		case '>': printf("_gt_"); break;
-		case ',': printf("_comma_"); break;
-		case '.': printf("_dot_"); break;
-		case '?': printf("_question_"); break;
-		case '/': printf("_slash_"); break;			
+		case '_' : s += "__"; break;
+		case '~': s += "_tilde_"; break;
+		case '`': s += "_backquote_"; break;
+		case '!': s += "_exclaim_"; break;
+		case '@': s += "_apos_"; break;
+		case '#': s += "_hash_"; break;
+		case '$': s += "_dollar_"; break;
+		case '%': s += "_percent_"; break;
+		case '^': s += "_caret_"; break;
+		case '&': s += "_amp_"; break;
+		case '*': s += "_star_"; break;
+		case '(': s += "_lparan_"; break;
+		case ')': s += "_rparan_"; break;
+		case '-': s += "_minus_"; break;
+		case '+': s += "_plus_"; break;
+		case '=': s += "_eq_"; break;
+		case '|': s += "_pipe_"; break;
+		case '\\': s += "_bslash_"; break;
+		case ':': s += "_colon_"; break;
+		case '<': s += "_lt_"; break;
+		case '>': s += "_gt_"; break;
+		case ',': s += "_comma_"; break;
+		case '.': s += "_dot_"; break;
+		case '?': s += "_question_"; break;
+		case '/': s += "_slash_"; break;			
 		default: 
 			assert((c >= '1' && c <= '9') || (c == '0') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'));
-			putchar(c);
+			s.push(c);
 			break;
 	}		
 }
@@ -61,13 +75,62 @@ void OutputNodeText(Node* p)
 		putchar(*i++);
 }
 
+// the interned text of each node, the tokens are contiguous characters of the input
+ootl::flat_hash_map<Node*, ootl::symbol> node_symbols;
+
+ootl::symbol NodeSymbol(Node* p)
+{
+	ootl::symbol* ret = node_symbols.find(p);
+	if (ret != NULL)
+		return *ret;
+	Iterator first = p->GetFirstToken();
+	ootl::symbol sym(&*first, p->GetLastToken() - first);
+	node_symbols.add(p, sym);
+	return sym;
+}
+
+// the C++ name of each Cat name, computed once per symbol
+ootl::flat_hash_map<ootl::symbol, ootl::string> mangled_names;
+
+const char* MangledName(ootl::symbol sym)
+{
+	ootl::string* p = mangled_names.find(sym);
+	if (p == NULL)
+	{
+		ootl::string s("_");
+		for (const char* c = sym.c_str(); *c != '\0'; ++c)
+			MangleChar(*c, s);
+		mangled_names.add(sym, s);
+		p = mangled_names.find(sym);
+	}
+	return p->c_str();
+}
+
+// the definitions that are implemented natively by cat_lib.hpp, these are
+// not output, though the quotations in them still are
+ootl::flat_hash_map<ootl::symbol, bool> native_defs;
+
+void InitNativeDefs()
+{
+	const char* names[] = { 
+		"apply", "apply2", "dip", "dip2", "curry", "rcompose", "rcurry", "k", "m", 
+		"map", "fold", "filter", "rev", "count", "nth", "drop", "take", "cat", 
+		"flatten", "split_at", "n"
+	};
+	for (size_t i=0; i < sizeof(names) / sizeof(names[0]); ++i)
+		native_defs.add(ootl::symbol(names[i]), true);
+}
+
+bool IsNativeDef(Node* p)
+{
+	assert(p->GetLabelId() == DefLabel::id);
+	return native_defs.contains(NodeSymbol(p->GetFirstChild()));
+}
+
 void OutputName(Node* p)
 {
 	assert(p->GetLabelId() == CatWordLabel::id);
-	printf("_"); 
-	Iterator i = p->GetFirstToken();	
-	while (i != p->GetLastToken())
-		printch(*i++);
+	printf("%s", MangledName(NodeSymbol(p)));
 }
 
 void OutputFxnSig(Node* p)
@@ -83,6 +146,8 @@ void OutputFxnSig(Node* p)
 void OutputForwardDecls(Node* p)
 {
 	assert(p->GetLabelId() == DefLabel::id);
+	if (IsNativeDef(p))
+		return;
 	OutputFxnSig(p);
 	printf(";\n");
 }
@@ -145,6 +210,8 @@ void OutputExpr(Node* p)
 
 void OutputFunctionDefs(Node* p)
 {
+	if (IsNativeDef(p))
+		return;
 	OutputFxnSig(p);
 	printf("\n{\n");
 	Node* pTmp = p->GetFirstChild();
@@ -181,11 +248,303 @@ void test_hash()
 		h.add(i, i);
 	for (int i=1; i < nSize; ++i)
 		assert(h[i] == i);
+
+	ootl::flat_hash_map<int, int> f;
+	for (int i=1; i < nSize; ++i)
+		f.add(i, i);
+	for (int i=1; i < nSize; ++i)
+		assert(f[i] == i);
+	assert(f.find(nSize) == NULL);
+
+	// both maps throw a std::runtime_error for a missing key
+	int nThrown = 0;
+	try { h[nSize]; } catch (std::runtime_error&) { ++nThrown; }
+	try { f[nSize]; } catch (std::runtime_error&) { ++nThrown; }
+	assert(nThrown == 2);
+}
+
+// takes a string from inline storage to a heap buffer and to a rope, with strings that
+// are appended to themselves along the way
+void test_string()
+{
+	// the buffer doubles up to past the threshold, so this is enough to make a rope
+	const size_t nRope = ootl::string::rope_threshold * 2;
+
+	ootl::string s("abc");
+	assert(s.count() == 3 && s == "abc" && !s.is_rope());
+	s.concat(s);
+	assert(s == "abcabc");
+	// appends characters of the string itself, first within the inline buffer, then 
+	// when the string moves to the heap
+	s.append(s.c_str() + 1, 2);
+	assert(s == "abcabcbc");
+	s.append(s.c_str(), 8);
+	assert(s.count() > ootl::string::inline_capacity);
+	assert(s == "abcabcbcabcabcbc");
+	assert(s.pop() == 'c' && s == "abcabcbcabcabcb");
+	assert(s + "!" == "abcabcbcabcabcb!" && s + s == "abcabcbcabcabcbabcabcbcabcabcb");
+
+	// a string that needs to grow past the threshold becomes a rope
+	ootl::string r;
+	for (size_t i=0; i < nRope + 100; ++i)
+		r.push((char)('a' + i % 26));
+	assert(r.is_rope() && r.count() == nRope + 100);
+	assert(r[0] == 'a' && r[(int)nRope] == (char)('a' + nRope % 26));
+	assert(r.pop() == (char)('a' + (nRope + 99) % 26));
+	assert(r.is_rope() && r.count() == nRope + 99);
+	ootl::string r2(r);
+	assert(r2.is_rope() && r2 == r);
+	r2.push('x');
+	r2.concat(r2);
+	assert(r2.count() == 2 * (nRope + 100));
+	assert(r2[(int)nRope + 99] == 'x' && r2[(int)nRope + 100] == 'a');
+	// c_str copies a rope into a contiguous buffer
+	const char* p = r.c_str();
+	assert(!r.is_rope() && strlen(p) == nRope + 99 && p[25] == 'z');
+	ootl::string t("xyz");
+	t.concat(r2);
+	assert(t.count() == 3 + r2.count() && t[2] == 'z' && t[3] == 'a');
+
+	// swapped and moved strings point to their own inline buffer
+	ootl::string a("short");
+	ootl::string b(r);
+	a.swap(b);
+	assert(b == "short" && a == r);
+	b.push('!');
+	a.push('!');
+	assert(b == "short!" && a.count() == r.count() + 1);
+#ifdef OOTL_HAS_MOVE
+	ootl::string c(std::move(b));
+	assert(c == "short!" && b.is_empty());
+	c.push('?');
+	assert(c == "short!?");
+	b = std::move(a);
+	assert(b.count() == r.count() + 1 && a.is_empty());
+#endif
+
+	// strings compare their lengths, not only the characters before a zero
+	ootl::string z("ab");
+	z.push('\0');
+	assert(z.count() == 3 && !(z == "ab") && !(z == ootl::string("ab")));
+}
+
+// a value with more than one field, stored as raw bytes
+struct mapped_test_value
+{
+	int n;
+	double d;
+};
+
+// writes a map file, reopens it and checks the contents. The file starts out small 
+// so that it is rehashed several times.
+void test_mapped_hash()
+{
+	const char* path = "test_mapped_hash.map";
+	const int nSize = 5000;
+	int nThrown = 0;
+
+	// a map that is not open is empty, and can't be added to
+	ootl::mapped_hash_map<int, mapped_test_value> m;
+	mapped_test_value v = { -1, -1.0 };
+	assert(!m.is_open() && m.is_empty() && m.find(1) == NULL && !m.contains(1));
+	try { m.add(1, v); } catch (std::runtime_error&) { ++nThrown; }
+	assert(nThrown == 1);
+
+	m.create(path);
+	for (int i=1; i <= nSize; ++i)
+	{
+		mapped_test_value x = { i, i * 0.5 };
+		m.add(i, x);
+	}
+	m.add(nSize, v);
+	assert(m.count() == nSize);
+	m.close();
+	assert(!m.is_open() && m.count() == 0 && !m.contains(1));
+
+	m.open_read_only(path);
+	assert(m.count() == nSize);
+	for (int i=1; i < nSize; ++i)
+		assert(m[i].n == i && m[i].d == i * 0.5);
+	assert(m[nSize].n == -1);
+	assert(!m.contains(0) && !m.contains(nSize + 1));
+	try { m.add(0, v); } catch (std::runtime_error&) { ++nThrown; }
+	assert(nThrown == 2);
+
+	// adds enough entries to a reopened file to rehash it again
+	m.open(path);
+	for (int i=nSize + 1; i <= nSize * 2; ++i)
+	{
+		mapped_test_value x = { i, i * 0.5 };
+		m.add(i, x);
+	}
+	m.close();
+	m.open_read_only(path);
+	assert(m.count() == nSize * 2);
+	for (int i=1; i <= nSize * 2; ++i)
+		assert(m[i].n == (i == nSize ? -1 : i));
+	m.close();
+	FILE* f = fopen("test_mapped_hash.map.tmp", "r");
+	assert(f == NULL);
+
+	// the header is checked when a file is opened
+	ootl::mapped_hash_map<int, int> other;
+	try { other.open_read_only(path); } catch (std::runtime_error&) { ++nThrown; }
+	assert(nThrown == 3 && !other.is_open());
+	f = fopen(path, "w");
+	fputs("not a hash map", f);
+	fclose(f);
+	try { m.open(path); } catch (std::runtime_error&) { ++nThrown; }
+	assert(nThrown == 4 && !m.is_open());
+	remove(path);
+}
+
+#ifdef OOTL_HAS_MOVE
+// one thread pushes the integers 0 to n - 1, while other threads read back every 
+// item as soon as it is published
+void test_concurrent_vlist()
+{
+	const int nItems = 200000;
+	const int nReaders = 4;
+	ootl::concurrent_vlist<int> v;
+	std::atomic<int> nErrors(0);
+	std::thread readers[nReaders];
+	for (int i=0; i < nReaders; ++i)
+		readers[i] = std::thread([&]() {
+			size_t nChecked = 0;
+			while (nChecked < (size_t)nItems)
+			{
+				size_t n = v.count();
+				for (; nChecked < n; ++nChecked)
+					if (v[nChecked] != (int)nChecked)
+						++nErrors;
+			}
+		});
+	for (int i=0; i < nItems; ++i)
+		v.push(i);
+	for (int i=0; i < nReaders; ++i)
+		readers[i].join();
+	assert(nErrors == 0);
+	assert(v.count() == nItems);
+	for (int i=0; i < nItems; ++i)
+		assert(v[i] == i);
+}
+
+// Each thread adds its own keys, then erases the even ones and replaces the values of
+// the odd ones, while looking up the keys of another thread. Then all the threads try
+// to insert the same keys, and each key must be inserted by exactly one of them.
+void test_concurrent_hash()
+{
+	const int nThreads = 4;
+	const int nKeys = 20000;
+	ootl::concurrent_hash_map<int, int> m(16);
+	std::atomic<int> nErrors(0);
+	std::atomic<int> nInserted(0);
+	std::thread threads[nThreads];
+	for (int t=0; t < nThreads; ++t)
+		threads[t] = std::thread([&, t]() {
+			int nFirst = t * nKeys;
+			for (int i=nFirst; i < nFirst + nKeys; ++i)
+				m.add(i, i * 10);
+			for (int i=nFirst; i < nFirst + nKeys; ++i)
+			{
+				if (i % 2 == 0)
+				{
+					if (!m.erase(i))
+						++nErrors;
+				}
+				else 
+				{
+					m.add(i, i * 10 + 1);
+				}
+				// the key may not be added yet, or already be erased
+				int k = (i + nKeys) % (nThreads * nKeys);
+				int v;
+				if (m.find(k, v) && v != k * 10 && v != k * 10 + 1)
+					++nErrors;
+			}
+			for (int i=0; i < nKeys; ++i)
+				if (m.insert_if_absent(-1 - i, t))
+					++nInserted;
+		});
+	for (int t=0; t < nThreads; ++t)
+		threads[t].join();
+	assert(nErrors == 0);
+	assert(nInserted == nKeys);
+	assert(m.count() == nThreads * nKeys / 2 + nKeys);
+	for (int i=0; i < nThreads * nKeys; ++i)
+	{
+		int v;
+		if (i % 2 == 0)
+			assert(!m.contains(i));
+		else
+			assert(m.find(i, v) && v == i * 10 + 1);
+	}
+	for (int i=0; i < nKeys; ++i)
+		assert(m.contains(-1 - i));
+	size_t nVisited = 0;
+	auto visit = [&](const int& k, const int& v) { ++nVisited; };
+	m.foreach(visit);
+	assert(nVisited == m.count());
+}
+#endif
+
+void run_tests()
+{
+	test_hash();
+	test_mapped_hash();
+	test_string();
+#ifdef OOTL_HAS_MOVE
+	test_concurrent_vlist();
+	test_concurrent_hash();
+#endif
+	printf("tests finished\n");
+}
+
+// compares the lookup throughput of hash_map and flat_hash_map, half of the 
+// lookups are misses
+template<typename Map_T>
+void bench_hash_map(const char* name, int nSize, int nLookups)
+{
+	Map_T m;
+	clock_t start = clock();
+	for (int i=1; i <= nSize; ++i)
+		m.add(i * 2, i);
+	clock_t mid = clock();
+	int nFound = 0;
+	for (int i=0; i < nLookups; ++i)
+		if (m.find((i % nSize) + 1) != NULL)
+			++nFound;
+	clock_t end = clock();
+	printf("%s: %d inserts %.3fs, %d lookups %.3fs (%d found)\n", name, nSize, 
+		(double)(mid - start) / CLOCKS_PER_SEC, nLookups, 
+		(double)(end - mid) / CLOCKS_PER_SEC, nFound);
+}
+
+void bench_hash()
+{
+	int nSizes[] = { 1000, 100000, 1000000 };
+	for (int i=0; i < 3; ++i)
+	{
+		bench_hash_map<ootl::hash_map<int, int> >("hash_map", nSizes[i], 10000000);
+		bench_hash_map<ootl::flat_hash_map<int, int> >("flat_hash_map", nSizes[i], 10000000);
+	}
 }
 
 int main(int argc, char* argv[])
 {	
-	//test_hash();
+	// runs the tests instead of translating
+	if (argc > 1 && strcmp(argv[1], "-test") == 0)
+	{
+		run_tests();
+		return 0;
+	}
+
+	// compares the hash maps instead of translating
+	if (argc > 1 && strcmp(argv[1], "-bench") == 0)
+	{
+		bench_hash();
+		return 0;
+	}
 
 	FILE* in = stdin; 
 	FILE* out = stdout;
@@ -212,6 +571,8 @@ int main(int argc, char* argv[])
 		} 
 	}
 
+	InitNativeDefs();
+
 	// get data from file
 	ootl::stack<char> char_stk; 
 	int c; 	
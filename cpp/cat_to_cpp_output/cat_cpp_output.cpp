@@ -6,6 +6,48 @@
 
 #include "output.hpp"
 
+// shows the order in which it is applied: appends the number of calls so far to 
+// the digits of an int
+int nOrderCalls = 0;
+
+void _order()
+{
+	int n = stk.pull().to<int>();
+	stk.push(n * 10 + ++nOrderCalls);
+}
+
+void _test__odd()
+{
+	int n = stk.pull().to<int>();
+	stk.push(n % 2 != 0);
+}
+
+// pushes a list of the digits in s, the first one is the head of the list. An 
+// underscore is an empty list.
+void push_digits(const char* s)
+{
+	call(_nil);
+	for (size_t i=strlen(s); i > 0; --i)
+	{
+		if (s[i - 1] == '_') {
+			call(_nil);
+		}
+		else {
+			push_literal(s[i - 1] - '0');
+		}
+		call(_cons);
+	}
+}
+
+// compares the top of the stack to the list written as for push_digits, and pops it
+void check_digits(const char* s)
+{
+	push_digits(s);
+	call(_eq);
+	cat_assert(stk[0] == true);
+	call(_pop);
+}
+
 void unit_tests()
 {
 	cat_assert(stk.count() == 0);
@@ -90,6 +132,133 @@ void unit_tests()
 	call(_whilene);
 	cat_assert(stk[0] == 0);
 	call(_pop);
+
+	// k removes the value below a function, without evaluating the function
+	push_literal(1);
+	push_literal(2);
+	push_function(_inc);
+	call(_k);
+	cat_assert(stk.count() == 2);
+	call(_apply);
+	cat_assert(stk.count() == 1);
+	cat_assert(stk[0] == 2);
+	call(_pop);
+
+	// ki is [i] k, which removes the value and leaves [i] above the function
+	push_literal(1);
+	push_function(_inc);
+	push_literal(5);
+	call(_ki);
+	cat_assert(stk.count() == 3);
+	cat_assert(stk[0].is<prim_function>());
+	call(_pop);
+	call(_apply);
+	cat_assert(stk.count() == 1);
+	cat_assert(stk[0] == 2);
+	call(_pop);
+
+	// apply2 applies the function to the top value first
+	push_literal(1);
+	push_literal(2);
+	push_function(_order);
+	call(_apply2);
+	cat_assert(stk.count() == 2);
+	cat_assert(stk[0] == 21);
+	cat_assert(stk[1] == 12);
+	call(_pop);
+	call(_pop);
+
+	// the list functions with indexes past the end, empty lists and nested lists, 
+	// giving the same results as the library.cat versions they replace
+	push_digits("123");
+	push_literal(3);
+	call(_nth);
+	check_digits("");
+	check_digits("123");
+	push_digits("");
+	push_literal(0);
+	call(_nth);
+	check_digits("");
+	check_digits("");
+
+	push_digits("123");
+	push_literal(5);
+	call(_drop);
+	check_digits("");
+	push_digits("");
+	push_literal(1);
+	call(_drop);
+	check_digits("");
+
+	push_digits("123");
+	push_literal(0);
+	call(_take);
+	check_digits("");
+	push_digits("12");
+	push_literal(4);
+	call(_take);
+	check_digits("12__");
+	push_digits("");
+	push_literal(2);
+	call(_take);
+	check_digits("__");
+
+	push_digits("123");
+	push_literal(2);
+	call(_split__at);
+	check_digits("21");
+	check_digits("3");
+	push_digits("12");
+	push_literal(3);
+	call(_split__at);
+	check_digits("_21");
+	check_digits("");
+
+	call(_nil);
+	push_digits("34");
+	call(_cons);
+	push_digits("");
+	call(_cons);
+	push_digits("12");
+	call(_cons);
+	call(_flatten);
+	check_digits("1234");
+	call(_nil);
+	call(_flatten);
+	check_digits("");
+
+	// the items of the second list go in front of the first
+	call(_nil);
+	push_digits("3");
+	call(_cons);
+	push_digits("12");
+	call(_cons);
+	push_digits("4");
+	call(_cat);
+	call(_nil);
+	push_digits("3");
+	call(_cons);
+	push_digits("12");
+	call(_cons);
+	push_literal(4);
+	call(_cons);
+	call(_eq);
+	cat_assert(stk[0] == true);
+	call(_pop);
+	push_digits("12");
+	push_digits("");
+	call(_cat);
+	check_digits("12");
+
+	push_digits("1234");
+	push_function(_test__odd);
+	call(_filter);
+	check_digits("13");
+	push_digits("");
+	push_function(_test__odd);
+	call(_filter);
+	check_digits("");
+	cat_assert(stk.count() == 0);
 }
 
 /// Some custom stuff.
@@ -104,7 +273,7 @@ void _anon3000()
 void _anon3001()
 {
 	call(_dec);
-	object tmp = stk.top();
+	cat_value tmp = stk.top();
 	call(_fib);
 	stk.push(tmp);
 	call(_dec);
@@ -135,8 +304,9 @@ int main(int argc, char* argv[])
 {
 	_fib_test();
 	print_stack();
+	stk.clear();
 
-    //unit_tests();
+	unit_tests();
 	try
 	{
 		//_run__tests();
@@ -7,25 +7,29 @@
 
 #include "..\ootl\ootl_object.hpp"
 #include "..\ootl\ootl_stack.hpp"
+#include "..\ootl\ootl_small_stack.hpp"
 #include "..\ootl\ootl_timer.hpp"
 
+#include "cat_value.hpp"
+
 using namespace ootl;
 
 //////////////////////////////////////////////////////////////////////////////
 // global data
 
-stack<object> stk;
+stack<cat_value> stk;
 
 //////////////////////////////////////////////////////////////////////////////
 // typedefs 
 
-typedef void(*fxn_ptr)();
-typedef stack<object> list;
+// lists are created and destroyed constantly and are usually tiny, so the 
+// first few items are stored inline and larger buffers are recycled
+typedef small_stack<cat_value, 4, default_vlist_policy, pooled_vlist_allocator> list;
 
 //////////////////////////////////////////////////////////////////////////////
 // forward declarations
 
-void _eval(object& o);
+void _eval(cat_value& o);
 
 //////////////////////////////////////////////////////////////////////////////
 // debugging stuff
@@ -53,24 +57,9 @@ void cat_assert(bool b)
 //////////////////////////////////////////////////////////////////////////////
 // function types
 
-struct prim_function
-{
-	prim_function(const fxn_ptr& f)
-		: fxn(f)
-	{ }
-	prim_function(const prim_function& f)
-		: fxn(f.fxn)
-	{ }
-	bool operator==(const prim_function& x) const 
-	{
-		return fxn == x.fxn;
-	}
-	fxn_ptr fxn;
-};
-
 struct quoted_value
 { 
-	quoted_value(object& o)
+	quoted_value(cat_value& o)
 	{
 		invalid = false;
 		o.move_to(value);
@@ -80,6 +69,13 @@ struct quoted_value
 	{
 		invalid = false;
 	}
+#ifdef OOTL_HAS_MOVE
+	quoted_value(quoted_value&& x)
+		: value(std::move(x.value))
+	{
+		invalid = x.invalid;
+	}
+#endif
 	bool operator==(const quoted_value& x) const 
 	{
 		return value == x.value;
@@ -94,7 +90,7 @@ struct quoted_value
 		invalid = true;
 	}
 	bool invalid;
-	object value;
+	cat_value value;
 };
 
 struct composed_function
@@ -104,7 +100,14 @@ struct composed_function
 	{ 
 		invalid = false;
 	}
-	composed_function(object& first, object& second)
+#ifdef OOTL_HAS_MOVE
+	composed_function(composed_function&& cf)
+		: fxns(std::move(cf.fxns))
+	{ 
+		invalid = cf.invalid;
+	}
+#endif
+	composed_function(cat_value& first, cat_value& second)
 	{
 		invalid = false;
 		fxns.push_nocreate();
@@ -112,7 +115,7 @@ struct composed_function
 		fxns.push_nocreate();
 		second.move_to(fxns.top());
 	}
-	void compose_with(object& o)
+	void compose_with(cat_value& o)
 	{
 		// TODO: check that o is a function. 
 		fxns.push_nocreate();
@@ -133,10 +136,15 @@ struct composed_function
 	list fxns;
 };
 
+// tags make cat_value::is<T>() a single integer comparison for boxed values
+OOTL_OBJECT_TYPE_TAG(list, ootl::object_first_user_tag)
+OOTL_OBJECT_TYPE_TAG(quoted_value, ootl::object_first_user_tag + 1)
+OOTL_OBJECT_TYPE_TAG(composed_function, ootl::object_first_user_tag + 2)
+
 //////////////////////////////////////////////////////////////////////////////
 // stack display functions
 
-void print_object(object& o);
+void print_object(cat_value& o);
 
 void print_list(list& l)
 {
@@ -145,7 +153,7 @@ void print_list(list& l)
 	printf(") ");
 }
 
-void print_object(object& o)
+void print_object(cat_value& o)
 {
 	if (o.is<int>())
 	{			
@@ -178,6 +186,10 @@ void print_object(object& o)
 	{
 		printf("fxn ");
 	}
+	else if (o.is<symbol>())
+	{
+		printf("\"%s\" ", o.to<symbol>().c_str());
+	}
 	else if (o.is_empty())
 	{
 		printf("invalid object!");
@@ -202,9 +214,13 @@ void print_stack()
 // note: a function object can only ever be evaluated once.	
 // this is because a quoted_value will literally move its value into 
 // the stack invalidating itself
-void _eval(object& o)
+void _eval(cat_value& o)
 {
-	if (o.is<quoted_value>())
+	if (o.is<prim_function>())
+	{
+		o.to_fxn()();
+	}
+	else if (o.is<quoted_value>())
 	{
 		o.to<quoted_value>().eval();
 	}
@@ -212,10 +228,6 @@ void _eval(object& o)
 	{
 		o.to<composed_function>().eval();
 	}
-	else if (o.is<prim_function>())
-	{
-		o.to<prim_function>().fxn();
-	}
 	else
 	{
 		// Not a function. Note that you could simply do nothing thus 
@@ -223,11 +235,12 @@ void _eval(object& o)
 		// This would give you different langauge semantics.
 		cat_assert(false);
 	}
-	o.release_nodestroy();
+	// the function is now empty, but its box still has to be freed
+	o.release();
 }
 
 // note: this is not a reference, so the object doesn't get invalidated
-void _eval_copy(object o)
+void _eval_copy(cat_value o)
 {
 	_eval(o);
 }
@@ -256,8 +269,8 @@ void push_literal(const T& x)
 // using the Y or M combinator, and would be of only mild theoretical interest
 void _while()
 {
-	object cond;
-	object body;
+	cat_value cond;
+	cat_value body;
 	stk.top().move_to(cond);
 	stk.pop_nodestroy();
 	stk.top().move_to(body);
@@ -278,51 +291,53 @@ void _empty()
 	stk.push(stk.top().to<list>().is_empty());
 }
 
+// the arithmetic functions overwrite the value on top of the stack, which for
+// inline ints never allocates or frees memory
 void _add__int()
 {
 	cat_assert(stk.count() >= 2);
 	int n = stk.pull().to<int>();
-	int m = stk.pull().to<int>();
-	stk.push(m + n);
+	cat_value& m = stk.top();
+	m = m.to<int>() + n;
 }
 
 void _mul__int()
 {
 	cat_assert(stk.count() >= 2);
 	int n = stk.pull().to<int>();
-	int m = stk.pull().to<int>();
-	stk.push(m * n);
+	cat_value& m = stk.top();
+	m = m.to<int>() * n;
 }
 
 void _div__int()
 {
 	cat_assert(stk.count() >= 2);
 	int n = stk.pull().to<int>();
-	int m = stk.pull().to<int>();
-	stk.push(m / n);
+	cat_value& m = stk.top();
+	m = m.to<int>() / n;
 }
 
 void _mod__int()
 {
 	cat_assert(stk.count() >= 2);
 	int n = stk.pull().to<int>();
-	int m = stk.pull().to<int>();
-	stk.push(m % n);
+	cat_value& m = stk.top();
+	m = m.to<int>() % n;
 }
 
 void _lt__int()
 {
 	cat_assert(stk.count() >= 2);
 	int n = stk.pull().to<int>();
-	int m = stk.pull().to<int>();
-	stk.push(m < n);
+	cat_value& m = stk.top();
+	m = m.to<int>() < n;
 }
 
 void _neg__int()
 {
 	cat_assert(stk.count() >= 1);
-	int n = stk.pull().to<int>();
-	stk.push(-n);
+	cat_value& n = stk.top();
+	n = -n.to<int>();
 }
 
 void _halt()
@@ -340,7 +355,7 @@ void _nil()
 void _cons()
 {
 	cat_assert(stk.count() >= 2);
-	object o;
+	cat_value o;
 	stk.top().move_to(o);
 	stk.pop_nodestroy();
 	list& lst = stk.top().to<list>();
@@ -365,7 +380,7 @@ void _uncons()
 void _eq()
 {
 	cat_assert(stk.count() >= 2);
-	object o;
+	cat_value o;
 	stk.top().move_to(o);
 	stk.pop_nodestroy();
 	if (stk.top() == o)
@@ -399,9 +414,9 @@ void _false()
 void _swap()
 {
 	cat_assert(stk.count() >= 2);
-	object& first = stk.top();
-	object& second = stk[1];
-	object tmp;
+	cat_value& first = stk.top();
+	cat_value& second = stk[1];
+	cat_value tmp;
 	first.move_to(tmp);
 	second.move_to(first);
 	tmp.move_to(second);
@@ -410,7 +425,7 @@ void _swap()
 void _quote()
 {
 	cat_assert(stk.count() >= 1);
-	object o;
+	cat_value o;
 	stk.top().move_to(o);
 	stk.pop_nodestroy();
 	stk.push(quoted_value(o));
@@ -419,10 +434,10 @@ void _quote()
 void _if()
 {
 	cat_assert(stk.count() >= 3);
-	object onfalse;
+	cat_value onfalse;
 	stk.top().move_to(onfalse);
 	stk.pop_nodestroy();
-	object ontrue;
+	cat_value ontrue;
 	stk.top().move_to(ontrue);
 	stk.pop_nodestroy();
 	bool bCond = stk.top().to<bool>();
@@ -442,7 +457,7 @@ void _if()
 void _compose()
 {
 	cat_assert(stk.count() >= 2);
-	object o;
+	cat_value o;
 	stk.top().move_to(o);
 	stk.pop_nodestroy();
 	if (stk.top().is<composed_function>())
@@ -452,13 +467,318 @@ void _compose()
 	}
 	else
 	{
-		object o2;
+		cat_value o2;
 		stk.top().move_to(o2);
 		stk.pop_nodestroy();
 		stk.push(composed_function(o2, o));
 	}
 }
 
+//////////////////////////////////////////////////////////////////////////////
+// native combinators 
+
+// These replace the definitions in library.cat, which build and then 
+// evaluate temporary quotations and compositions. The translator does not 
+// output the Cat versions.
+
+// moves the top of the stack into o, which must be empty
+void pop_to(cat_value& o)
+{
+	stk.top().move_to(o);
+	stk.pop_nodestroy();
+}
+
+void _apply()
+{
+	cat_assert(stk.count() >= 1);
+	cat_value f;
+	pop_to(f);
+	_eval(f);
+}
+
+// like the Cat version, under apply [apply] dip, f is applied to b before a
+void _apply2()
+{
+	cat_assert(stk.count() >= 3);
+	cat_value f;
+	pop_to(f);
+	_eval_copy(f);
+	cat_value b;
+	pop_to(b);
+	_eval(f);
+	stk.push_nocreate();
+	b.move_to(stk.top());
+}
+
+void _dip()
+{
+	cat_assert(stk.count() >= 2);
+	cat_value f;
+	pop_to(f);
+	cat_value b;
+	pop_to(b);
+	_eval(f);
+	stk.push_nocreate();
+	b.move_to(stk.top());
+}
+
+void _dip2()
+{
+	cat_assert(stk.count() >= 3);
+	cat_value f;
+	pop_to(f);
+	cat_value c;
+	pop_to(c);
+	cat_value b;
+	pop_to(b);
+	_eval(f);
+	stk.push_nocreate();
+	b.move_to(stk.top());
+	stk.push_nocreate();
+	c.move_to(stk.top());
+}
+
+void _curry()
+{
+	cat_assert(stk.count() >= 2);
+	cat_value f;
+	pop_to(f);
+	cat_value a;
+	pop_to(a);
+	cat_value q = quoted_value(a);
+	stk.push(composed_function(q, f));
+}
+
+void _rcompose()
+{
+	_swap();
+	_compose();
+}
+
+void _rcurry()
+{
+	_swap();
+	_curry();
+}
+
+// like the Cat version, [pop] dip, f is not evaluated
+void _k()
+{
+	cat_assert(stk.count() >= 2);
+	cat_value f;
+	pop_to(f);
+	stk.pop();
+	stk.push_nocreate();
+	f.move_to(stk.top());
+}
+
+void _m()
+{
+	cat_assert(stk.count() >= 1);
+	_eval_copy(stk.top());
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// native list functions
+
+// These replace the list functions of library.cat, which are built from
+// uncons, cons and fold, with the same stack effects. Lists are modified in 
+// place where the Cat version consumes them. Note that list[0] is the head 
+// of a list, and that functions are evaluated on the items in the same order 
+// as in the Cat versions.
+
+// removes the items above the first n items from the bottom of a list
+void truncate_list(list& l, size_t n)
+{
+	if (l.count() > n)
+		l.pop_n(l.count() - n);
+}
+
+void _count()
+{
+	cat_assert(stk.count() >= 1);
+	stk.push((int)stk.top().to<list>().count());
+}
+
+void _rev()
+{
+	cat_assert(stk.count() >= 1);
+	list& l = stk.top().to<list>();
+	size_t n = l.count();
+	for (size_t i=0; i < n / 2; ++i)
+		std::swap(l[i], l[n - i - 1]);
+}
+
+void _nth()
+{
+	cat_assert(stk.count() >= 2);
+	int n = stk.pull().to<int>();
+	cat_assert(n >= 0);
+	list& l = stk.top().to<list>();
+	// like head, the nth item of a list that is too short is an empty list
+	if ((size_t)n < l.count())
+		stk.push(l[n]);
+	else 
+		stk.push(list());
+}
+
+void _drop()
+{
+	cat_assert(stk.count() >= 2);
+	int n = stk.pull().to<int>();
+	cat_assert(n >= 0);
+	list& l = stk.top().to<list>();
+	l.pop_n((size_t)n < l.count() ? n : l.count());
+}
+
+void _take()
+{
+	cat_assert(stk.count() >= 2);
+	int n = stk.pull().to<int>();
+	cat_assert(n >= 0);
+	list& l = stk.top().to<list>();
+	size_t cnt = l.count();
+	if ((size_t)n <= cnt)
+	{
+		// moves the first n items to the bottom of the list
+		for (int i=0; i < n; ++i)
+			std::swap(l[cnt - i - 1], l[n - i - 1]);
+		truncate_list(l, n);
+	}
+	else
+	{
+		// like the Cat version, a list that is too short is padded at the 
+		// end with empty lists 
+		list tmp;
+		tmp.push_n(n - cnt, list());
+		tmp.splice(l);
+		l.swap(tmp);
+	}
+}
+
+void _split__at()
+{
+	cat_assert(stk.count() >= 2);
+	int n = stk.pull().to<int>();
+	cat_assert(n >= 0);
+	list& l = stk.top().to<list>();
+	stk.push(list());
+	list& first = stk.top().to<list>();
+	// moves the first n items, one at a time, like move_head
+	for (int i=0; i < n; ++i)
+	{
+		if (l.is_empty())
+		{
+			first.push(list());
+		}
+		else
+		{
+			first.push_nocreate();
+			l.top().move_to(first.top());
+			l.pop_nodestroy();
+		}
+	}
+}
+
+void _cat()
+{
+	cat_assert(stk.count() >= 2);
+	cat_value second;
+	pop_to(second);
+	list& l = stk.top().to<list>();
+	l.splice(second.to<list>());
+}
+
+void _flatten()
+{
+	cat_assert(stk.count() >= 1);
+	list& l = stk.top().to<list>();
+	list tmp;
+	for (size_t i=l.count(); i > 0; --i)
+		tmp.splice(l[i - 1].to<list>());
+	l.swap(tmp);
+}
+
+void _fold()
+{
+	cat_assert(stk.count() >= 3);
+	cat_value f;
+	pop_to(f);
+	cat_value init;
+	pop_to(init);
+	cat_value o;
+	pop_to(o);
+	list& l = o.to<list>();
+	stk.push_nocreate();
+	init.move_to(stk.top());
+	while (!l.is_empty())
+	{
+		stk.push_nocreate();
+		l.top().move_to(stk.top());
+		l.pop_nodestroy();
+		_eval_copy(f);
+	}
+}
+
+void _map()
+{
+	cat_assert(stk.count() >= 2);
+	cat_value f;
+	pop_to(f);
+	cat_value o;
+	pop_to(o);
+	list& l = o.to<list>();
+	for (size_t i=0; i < l.count(); ++i)
+	{
+		stk.push_nocreate();
+		l[i].move_to(stk.top());
+		_eval_copy(f);
+		stk.top().move_to(l[i]);
+		stk.pop_nodestroy();
+	}
+	stk.push_nocreate();
+	o.move_to(stk.top());
+}
+
+void _filter()
+{
+	cat_assert(stk.count() >= 2);
+	cat_value f;
+	pop_to(f);
+	cat_value o;
+	pop_to(o);
+	list& l = o.to<list>();
+	// the items that are kept are moved down to the bottom of the list
+	size_t cnt = l.count();
+	size_t nKept = 0;
+	for (size_t i=0; i < cnt; ++i)
+	{
+		cat_value& x = l[cnt - i - 1];
+		stk.push(x);
+		_eval_copy(f);
+		if (stk.pull().to<bool>())
+		{
+			if (nKept != i)
+				std::swap(l[cnt - nKept - 1], x);
+			++nKept;
+		}
+	}
+	truncate_list(l, nKept);
+	stk.push_nocreate();
+	o.move_to(stk.top());
+}
+
+void _n()
+{
+	cat_assert(stk.count() >= 1);
+	int n = stk.pull().to<int>();
+	cat_assert(n >= 0);
+	stk.push(list());
+	list& l = stk.top().to<list>();
+	for (int i=0; i < n; ++i)
+		l.push(i);
+}
+
 void _test()
 {
 	static int nTest = 0;
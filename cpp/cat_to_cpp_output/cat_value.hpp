@@ -0,0 +1,360 @@
+// Public domain Cat interpreter
+// by Christopher Diggins
+// http://www.cat-language.com
+
+// The values on the Cat stack. A cat_value is 8 bytes: ints, bools and primitive
+// functions are stored inline, shifted left past a tag in the low bits. Any other value
+// is stored in a box allocated from a pool, and the cat_value is a pointer to it, whose
+// low bits are zero since boxes are aligned. Testing, reading or writing an inline value
+// is a few instructions, and never an indirect call or an allocation.
+
+#ifndef CAT_VALUE_HPP
+#define CAT_VALUE_HPP
+
+#include <stdexcept>
+
+#include "..\ootl\ootl_object.hpp"
+#include "..\ootl\ootl_pool.hpp"
+
+typedef void(*fxn_ptr)();
+
+struct prim_function
+{
+	prim_function(const fxn_ptr& f)
+		: fxn(f)
+	{ }
+	prim_function(const prim_function& f)
+		: fxn(f.fxn)
+	{ }
+	bool operator==(const prim_function& x) const
+	{
+		return fxn == x.fxn;
+	}
+	fxn_ptr fxn;
+};
+
+//////////////////////////////////////////////////////////////////////////////
+// boxes, for values that are not stored inline
+
+struct cat_box;
+
+struct cat_box_table
+{
+	unsigned int tag;
+	ootl::TI (*type_info)();
+	void (*destroy)(cat_box*);
+	cat_box* (*clone)(const cat_box*);
+	bool (*equals)(const cat_box*, const cat_box*);
+};
+
+struct cat_box
+{
+	const cat_box_table* table;
+};
+
+template<typename T>
+struct cat_boxed : cat_box
+{
+	typedef ootl::pool_allocator<cat_boxed> allocator;
+
+	cat_boxed(const T& x)
+		: value(x)
+	{
+		table = &table_value;
+	}
+#ifdef OOTL_HAS_MOVE
+	cat_boxed(T&& x)
+		: value(std::move(x))
+	{
+		table = &table_value;
+	}
+#endif
+
+	static cat_box* create(const T& x)
+	{
+		void* p = allocator::allocate();
+		try { return new(p) cat_boxed(x); }
+		catch (...) { allocator::deallocate(p); throw; }
+	}
+#ifdef OOTL_HAS_MOVE
+	static cat_box* create_move(T& x)
+	{
+		void* p = allocator::allocate();
+		try { return new(p) cat_boxed(std::move(x)); }
+		catch (...) { allocator::deallocate(p); throw; }
+	}
+#endif
+	static const cat_boxed* cast(const cat_box* x) { return static_cast<const cat_boxed*>(x); }
+	static ootl::TI type_info() { return typeid(T); }
+	static void destroy(cat_box* x)
+	{
+		cat_boxed* p = static_cast<cat_boxed*>(x);
+		p->~cat_boxed();
+		allocator::deallocate(p);
+	}
+	static cat_box* clone(const cat_box* x) { return create(cast(x)->value); }
+	static bool equals(const cat_box* x, const cat_box* y) { return cast(x)->value == cast(y)->value; }
+
+	static const cat_box_table table_value;
+	T value;
+};
+
+template<typename T>
+const cat_box_table cat_boxed<T>::table_value = {
+	ootl::object_type_tag<T>::value
+  , &cat_boxed<T>::type_info
+  , &cat_boxed<T>::destroy
+  , &cat_boxed<T>::clone
+  , &cat_boxed<T>::equals
+};
+
+//////////////////////////////////////////////////////////////////////////////
+// cat_value
+
+// how a cat_value holds a T, see the specializations below
+template<typename T>
+struct cat_value_type;
+
+struct cat_value
+{
+	typedef ootl::u8 u8;
+
+	// the tags in the low bits. A value with the boxed tag is a pointer, or 0 if empty.
+	static const u8 boxed_tag = 0;
+	static const u8 int_tag = 1;
+	static const u8 bool_tag = 2;
+	static const u8 fxn_tag = 3;
+	static const int tag_bits = 3;
+	static const u8 tag_mask = (1 << tag_bits) - 1;
+
+	// fails to compile if the pool doesn't align boxes enough to leave room for the tag
+	typedef char check_box_alignment[(1 << tag_bits) <= ootl::pool_allocator<cat_box>::min_alignment ? 1 : -1];
+
+	// constructors
+	cat_value()
+		: bits(0)
+	{ }
+	cat_value(int x)
+		: bits(((u8)(long long)x << tag_bits) | int_tag)
+	{ }
+	cat_value(bool x)
+		: bits(((u8)x << tag_bits) | bool_tag)
+	{ }
+	// assumes that the top bits of code addresses are zero, as they are
+	// for user code on current 64 bit platforms
+	cat_value(const prim_function& x)
+		: bits(((u8)(size_t)x.fxn << tag_bits) | fxn_tag)
+	{
+		ootl_assert(to_fxn() == x.fxn);
+	}
+	// strings are held as interned symbols
+	cat_value(const char* x)
+		: bits(from_box(cat_boxed<ootl::symbol>::create(ootl::symbol(x))))
+	{ }
+	template<typename T>
+	cat_value(const T& x)
+		: bits(from_box(cat_boxed<T>::create(x)))
+	{ }
+	cat_value(const cat_value& x)
+		: bits(x.bits)
+	{
+		if (is_boxed())
+			bits = from_box(to_box()->table->clone(to_box()));
+	}
+#ifdef OOTL_HAS_MOVE
+	cat_value(cat_value&& x)
+		: bits(x.bits)
+	{
+		x.bits = 0;
+	}
+	// moves a temporary value into a box, instead of copying it
+	template<typename T>
+	cat_value(T&& x, typename std::enable_if<!std::is_reference<T>::value
+		&& !std::is_same<typename std::decay<T>::type, cat_value>::value
+		&& !std::is_arithmetic<T>::value
+		&& !std::is_same<typename std::decay<T>::type, prim_function>::value
+		&& !std::is_convertible<T, const char*>::value>::type* = NULL)
+		: bits(from_box(cat_boxed<T>::create_move(x)))
+	{ }
+#endif
+	~cat_value()
+	{
+		release();
+	}
+
+	// assignment
+	cat_value& operator=(const cat_value& x)
+	{
+		if (this != &x)
+		{
+			cat_value tmp(x);
+			release();
+			tmp.move_to(*this);
+		}
+		return *this;
+	}
+#ifdef OOTL_HAS_MOVE
+	cat_value& operator=(cat_value&& x)
+	{
+		if (this != &x)
+		{
+			release();
+			x.move_to(*this);
+		}
+		return *this;
+	}
+#endif
+	template<typename T>
+	cat_value& operator=(const T& x)
+	{
+		cat_value tmp(x);
+		release();
+		tmp.move_to(*this);
+		return *this;
+	}
+
+	// member functions
+	ootl::TI type_info() const
+	{
+		switch (tag())
+		{
+			case int_tag: return typeid(int);
+			case bool_tag: return typeid(bool);
+			case fxn_tag: return typeid(prim_function);
+		}
+		if (is_empty())
+			return typeid(ootl::object_empty);
+		return to_box()->table->type_info();
+	}
+	template<typename T>
+	bool is() const
+	{
+		return cat_value_type<T>::is(*this);
+	}
+	// returns inline values by value, and boxed values by reference
+	template<typename T>
+	typename cat_value_type<T>::result to()
+	{
+		if (!is<T>())
+			throw ootl::object::bad_object_cast(type_info(), typeid(T));
+		return cat_value_type<T>::get(*this);
+	}
+	bool is_empty() const
+	{
+		return bits == 0;
+	}
+	bool is_boxed() const
+	{
+		return tag() == boxed_tag && bits != 0;
+	}
+	u8 tag() const
+	{
+		return bits & tag_mask;
+	}
+	// o must be empty
+	void move_to(cat_value& o)
+	{
+		o.bits = bits;
+		bits = 0;
+	}
+	void release()
+	{
+		if (is_boxed())
+			to_box()->table->destroy(to_box());
+		bits = 0;
+	}
+	void release_nodestroy()
+	{
+		bits = 0;
+	}
+	bool operator==(const cat_value& x) const
+	{
+		if (bits == x.bits)
+			return true;
+		if (!is_boxed() || !x.is_boxed())
+			return false;
+		return to_box()->table == x.to_box()->table
+			&& to_box()->table->equals(to_box(), x.to_box());
+	}
+
+	// raw access to the inline values and the box, these do not check the tag
+	int to_int() const
+	{
+		return (int)((long long)bits >> tag_bits);
+	}
+	bool to_bool() const
+	{
+		return (bits >> tag_bits) != 0;
+	}
+	fxn_ptr to_fxn() const
+	{
+		return (fxn_ptr)(size_t)(bits >> tag_bits);
+	}
+	cat_box* to_box() const
+	{
+		return (cat_box*)(size_t)bits;
+	}
+
+private:
+
+	// a misaligned box would be read back as an inline value, so this is checked 
+	// in release builds too
+	static u8 from_box(cat_box* x)
+	{
+		if (((size_t)x & tag_mask) != 0)
+			throw std::runtime_error("cat_value box is not aligned");
+		return (u8)(size_t)x;
+	}
+
+	// fields
+	u8 bits;
+};
+
+// values are moved with memcpy by small_stack
+OOTL_RELOCATABLE(cat_value)
+
+// boxed values
+template<typename T>
+struct cat_value_type
+{
+	typedef T& result;
+	static bool is(const cat_value& x)
+	{
+		if (!x.is_boxed())
+			return false;
+		if (ootl::object_type_tag<T>::value != ootl::object_untagged_type)
+			return x.to_box()->table->tag == ootl::object_type_tag<T>::value;
+		return x.to_box()->table->type_info() == typeid(T);
+	}
+	static T& get(const cat_value& x)
+	{
+		return static_cast<cat_boxed<T>*>(x.to_box())->value;
+	}
+};
+
+// inline values
+template<>
+struct cat_value_type<int>
+{
+	typedef int result;
+	static bool is(const cat_value& x) { return x.tag() == cat_value::int_tag; }
+	static int get(const cat_value& x) { return x.to_int(); }
+};
+
+template<>
+struct cat_value_type<bool>
+{
+	typedef bool result;
+	static bool is(const cat_value& x) { return x.tag() == cat_value::bool_tag; }
+	static bool get(const cat_value& x) { return x.to_bool(); }
+};
+
+template<>
+struct cat_value_type<prim_function>
+{
+	typedef prim_function result;
+	static bool is(const cat_value& x) { return x.tag() == cat_value::fxn_tag; }
+	static prim_function get(const cat_value& x) { return prim_function(x.to_fxn()); }
+};
+
+#endif
@@ -4,18 +4,12 @@
 
 // http://www.cat-language.com
 
-void _apply();
-void _apply2();
-void _dip();
-void _dip2();
 void _b();
 void _c();
 void _d();
 void _i();
-void _k();
 void _ki();
 void _l();
-void _m();
 void _o();
 void _r();
 void _s();
@@ -34,10 +28,7 @@ void _eqf();
 void _neq();
 void _neqf();
 void _neqz();
-void _curry();
 void _curry2();
-void _rcompose();
-void _rcurry();
 void _for();
 void _for__each();
 void _repeat();
@@ -45,34 +36,22 @@ void _rfor();
 void _whilen();
 void _whilene();
 void _whilenz();
-void _cat();
 void _consd();
-void _count();
 void _count__while();
-void _drop();
 void _drop__while();
-void _filter();
 void _first();
-void _flatten();
-void _fold();
 void _gen();
 void _head();
 void _last();
-void _map();
 void _mid();
 void _move__head();
-void _n();
-void _nth();
 void _pair();
-void _rev();
 void _rmap();
 void _set__at();
 void _small();
 void _split();
-void _split__at();
 void _swons();
 void _tail();
-void _take();
 void _take__while();
 void _triple();
 void _unpair();
@@ -332,33 +311,6 @@ void _cat_anon227();
 void _cat_anon228();
 void _cat_anon229();
 void _cat_anon230();
-void _apply()
-{
-    call(_true);
-    call(_swap);
-    push_function(_cat_anon0); //[]
-    call(_if);
-}
-void _apply2()
-{
-    call(_under);
-    call(_apply);
-    push_function(_cat_anon1); //[apply]
-    call(_dip);
-}
-void _dip()
-{
-    call(_swap);
-    call(_quote);
-    call(_compose);
-    call(_apply);
-}
-void _dip2()
-{
-    call(_swap);
-    push_function(_cat_anon2); //[dip]
-    call(_dip);
-}
 void _b()
 {
     push_function(_cat_anon3); //[k]
@@ -382,11 +334,6 @@ void _i()
     push_function(_cat_anon13); //[k]
     call(_s);
 }
-void _k()
-{
-    push_function(_cat_anon14); //[pop]
-    call(_dip);
-}
 void _ki()
 {
     push_function(_cat_anon15); //[i]
@@ -398,11 +345,6 @@ void _l()
     push_function(_cat_anon17); //[b]
     call(_c);
 }
-void _m()
-{
-    call(_dup);
-    call(_apply);
-}
 void _o()
 {
     push_function(_cat_anon18); //[i]
@@ -508,27 +450,11 @@ void _neqz()
     push_literal(0 );
     call(_neq);
 }
-void _curry()
-{
-    push_function(_cat_anon36); //[quote]
-    call(_dip);
-    call(_compose);
-}
 void _curry2()
 {
     call(_curry);
     call(_curry);
 }
-void _rcompose()
-{
-    call(_swap);
-    call(_compose);
-}
-void _rcurry()
-{
-    call(_swap);
-    call(_curry);
-}
 void _for()
 {
     call(_swap);
@@ -587,25 +513,11 @@ void _whilenz()
     call(_while);
     call(_pop);
 }
-void _cat()
-{
-    call(_rev);
-    call(_swap);
-    push_function(_cat_anon48); //[cons]
-    call(_fold);
-}
 void _consd()
 {
     push_function(_cat_anon49); //[cons]
     call(_dip);
 }
-void _count()
-{
-    call(_dup);
-    push_literal(0 );
-    push_function(_cat_anon50); //[pop inc]
-    call(_fold);
-}
 void _count__while()
 {
     push_function(_cat_anon51); //[dup 0 swap]
@@ -617,50 +529,17 @@ void _count__while()
     call(_while);
     call(_pop);
 }
-void _drop()
-{
-    push_function(_cat_anon56); //[[tail] dip dec]
-    call(_whilenz);
-}
 void _drop__while()
 {
     call(_count__while);
     call(_drop);
 }
-void _filter()
-{
-    push_function(_cat_anon57); //[rev]
-    call(_dip);
-    push_function(_cat_anon60); //[[cons] [pop] if]
-    call(_compose);
-    push_function(_cat_anon61); //[dup]
-    call(_rcompose);
-    call(_nil);
-    call(_swap);
-    call(_fold);
-}
 void _first()
 {
     call(_dup);
     call(_uncons);
     call(_popd);
 }
-void _flatten()
-{
-    call(_rev);
-    call(_nil);
-    push_function(_cat_anon62); //[cat]
-    call(_fold);
-}
-void _fold()
-{
-    call(_swapd);
-    push_function(_cat_anon63); //[dip]
-    call(_curry);
-    push_function(_cat_anon64); //[uncons swap]
-    call(_rcompose);
-    call(_whilene);
-}
 void _gen()
 {
     call(_nil);
@@ -685,11 +564,6 @@ void _last()
     call(_dec);
     call(_nth);
 }
-void _map()
-{
-    call(_rmap);
-    call(_rev);
-}
 void _mid()
 {
     call(_count);
@@ -703,32 +577,12 @@ void _move__head()
     call(_swap);
     call(_consd);
 }
-void _n()
-{
-    call(_nil);
-    call(_swap);
-    push_function(_cat_anon69); //[cons]
-    call(_swap);
-    call(_for);
-}
-void _nth()
-{
-    call(_dupd);
-    call(_drop);
-    call(_head);
-}
 void _pair()
 {
     push_function(_cat_anon70); //[unit]
     call(_dip);
     call(_cons);
 }
-void _rev()
-{
-    call(_nil);
-    push_function(_cat_anon71); //[cons]
-    call(_fold);
-}
 void _rmap()
 {
     call(_nil);
@@ -760,15 +614,6 @@ void _split()
     call(_compose);
     call(_filter);
 }
-void _split__at()
-{
-    call(_nil);
-    call(_bury);
-    push_function(_cat_anon76); //[move_head]
-    call(_swap);
-    call(_repeat);
-    call(_swap);
-}
 void _swons()
 {
     call(_swap);
@@ -779,15 +624,6 @@ void _tail()
     call(_uncons);
     call(_pop);
 }
-void _take()
-{
-    call(_nil);
-    call(_bury);
-    push_function(_cat_anon78); //[[move_head] dip dec]
-    call(_whilenz);
-    call(_pop);
-    call(_rev);
-}
 void _take__while()
 {
     call(_count__while);
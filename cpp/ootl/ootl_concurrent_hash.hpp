@@ -0,0 +1,525 @@
+// Public Domain by Christopher Diggins
+// http://www.ootl.org
+//
+// A hash map that can be shared by many threads. The keys are spread over a number of
+// shards, each a chained hash table with its own mutex. Only threads that modify a shard
+// take its lock: lookups never lock, they follow the bucket chains while inside of an
+// epoch (see epoch_domain below). Nodes are never modified once they are published,
+// so replacing a value links in a new node, and a node that is unlinked (or a table that
+// is replaced when a shard grows) is only freed once no reader can still be using it.
+//
+// Values are returned by copy, since a reference could outlive the entry. Requires C++11.
+
+#ifndef OOTL_CONCURRENT_HASH_HPP
+#define OOTL_CONCURRENT_HASH_HPP
+
+#include <atomic>
+#include <mutex>
+
+#include "ootl_hash.hpp"
+
+namespace ootl
+{
+	/////////////////////////////////////////////////////////
+	// epoch based reclamation
+	//
+	// A reader announces the global epoch it observed when it enters, and clears it when it
+	// leaves. The global epoch only advances when every reader inside has announced the
+	// current one, so an object that is unlinked and then retired during epoch e can no longer
+	// be reached by anyone once the global epoch reaches e + 2.
+	//
+	// Each thread keeps a single record, so there is only one domain, which is returned
+	// by default_epoch_domain().
+
+	struct epoch_domain
+	{
+		// one per thread, records are reused by new threads but never freed
+		struct record
+		{
+			record() : epoch(0), in_use(true), nesting(0), next(NULL) { }
+			// zero when the thread is not inside of an epoch
+			std::atomic<u8> epoch;
+			std::atomic<bool> in_use;
+			// only used by the owning thread
+			size_t nesting;
+			record* next;
+		};
+
+		void enter()
+		{
+			record* r = local();
+			if (r->nesting++ > 0)
+				return;
+			u8 e;
+			do
+			{
+				e = mnEpoch.load();
+				r->epoch.store(e);
+			}
+			while (mnEpoch.load() != e);
+		}
+
+		void leave()
+		{
+			record* r = local();
+			if (--r->nesting == 0)
+				r->epoch.store(0, std::memory_order_release);
+		}
+
+		u8 current() const
+		{
+			return mnEpoch.load();
+		}
+
+		// advances the global epoch if every active thread has seen the current one
+		bool try_advance()
+		{
+			u8 e = mnEpoch.load();
+			for (record* p = mpHead.load(); p != NULL; p = p->next)
+			{
+				u8 n = p->epoch.load();
+				if (n != 0 && n != e)
+					return false;
+			}
+			return mnEpoch.compare_exchange_strong(e, e + 1);
+		}
+
+		// true if an object retired during epoch e can be freed
+		bool is_safe(u8 e) const
+		{
+			return mnEpoch.load() >= e + 2;
+		}
+
+	private:
+
+		friend epoch_domain& default_epoch_domain();
+
+		epoch_domain() : mnEpoch(1), mpHead(NULL) { }
+
+		~epoch_domain()
+		{
+			record* p = mpHead.load();
+			while (p != NULL)
+			{
+				record* tmp = p->next;
+				delete p;
+				p = tmp;
+			}
+		}
+
+		// releases the record of a thread when it exits
+		struct holder
+		{
+			holder() : p(NULL) { }
+			~holder()
+			{
+				if (p != NULL)
+					p->in_use.store(false);
+			}
+			record* p;
+		};
+
+		record* local()
+		{
+			static thread_local holder h;
+			// the record belongs to the only domain, see default_epoch_domain()
+			if (h.p == NULL)
+				h.p = acquire();
+			return h.p;
+		}
+
+		record* acquire()
+		{
+			for (record* p = mpHead.load(); p != NULL; p = p->next)
+			{
+				bool b = false;
+				if (!p->in_use.load() && p->in_use.compare_exchange_strong(b, true))
+					return p;
+			}
+			record* r = new record();
+			r->next = mpHead.load();
+			while (!mpHead.compare_exchange_weak(r->next, r))
+				;
+			return r;
+		}
+
+		// hide the copy constructor and assignment operator
+		epoch_domain(const epoch_domain&);
+		void operator=(const epoch_domain&);
+
+		std::atomic<u8> mnEpoch;
+		std::atomic<record*> mpHead;
+	};
+
+	// the epoch domain shared by all of the concurrent containers
+	inline epoch_domain& default_epoch_domain()
+	{
+		static epoch_domain domain;
+		return domain;
+	}
+
+	// keeps the calling thread inside of an epoch for its lifetime. Guards can be nested.
+	struct epoch_guard
+	{
+		epoch_guard() { default_epoch_domain().enter(); }
+		~epoch_guard() { default_epoch_domain().leave(); }
+	private:
+		epoch_guard(const epoch_guard&);
+		void operator=(const epoch_guard&);
+	};
+
+	/////////////////////////////////////////////////////////
+	// concurrent_hash_map
+
+	template<typename key_T, typename value_T, typename hash_T = hasher<key_T> >
+	struct concurrent_hash_map
+	{
+		typedef concurrent_hash_map self;
+
+		// the number of buckets of a new shard, shards grow when they hold more
+		// entries than buckets
+		static const size_t initial_buckets = 16;
+
+		// the number of retired objects a shard collects before trying to free them
+		static const size_t reclaim_threshold = 64;
+
+		// nShards is rounded up to a power of two, it should be a few times the
+		// number of threads
+		concurrent_hash_map(size_t nShards = 64)
+			: mnShards(size_t(1) << ceil_log2(nShards < 1 ? 1 : nShards))
+		{
+			mpShards = new shard[mnShards];
+		}
+
+		// no other thread may use the map while it is destroyed
+		~concurrent_hash_map()
+		{
+			for (size_t i = 0; i < mnShards; ++i)
+			{
+				shard& s = mpShards[i];
+				table* t = s.tbl.load();
+				for (size_t j = 0; j < t->size; ++j)
+					delete_chain(t->buckets[j].load());
+				delete t;
+				while (!s.garbage.is_empty())
+				{
+					retired r = s.garbage.pull();
+					r.deleter(r.p);
+				}
+			}
+			delete[] mpShards;
+		}
+
+		//////////////////////////////////////////////////////
+		// lookup functions, these never lock
+
+		// copies the value associated with the key into x, returns false if there is none
+		bool find(const key_T& key, value_T& x)
+		{
+			u8 h = hash(key);
+			epoch_guard g;
+			node* p = find_node(get_shard(h).tbl.load(std::memory_order_acquire), h, key);
+			if (p == NULL)
+				return false;
+			x = p->value;
+			return true;
+		}
+
+		bool contains(const key_T& key)
+		{
+			u8 h = hash(key);
+			epoch_guard g;
+			return find_node(get_shard(h).tbl.load(std::memory_order_acquire), h, key) != NULL;
+		}
+
+		// the number of entries, this may be out of date as soon as it is returned
+		size_t count() const
+		{
+			size_t ret = 0;
+			for (size_t i = 0; i < mnShards; ++i)
+				ret += mpShards[i].count.load(std::memory_order_relaxed);
+			return ret;
+		}
+
+		bool is_empty() const
+		{
+			return count() == 0;
+		}
+
+		// calls proc(key, value) on each entry. Entries that are added or removed while
+		// foreach is running may or may not be visited, but no entry is visited twice
+		// unless its value is replaced.
+		template<typename Procedure>
+		void foreach(Procedure& proc)
+		{
+			epoch_guard g;
+			for (size_t i = 0; i < mnShards; ++i)
+			{
+				table* t = mpShards[i].tbl.load(std::memory_order_acquire);
+				for (size_t j = 0; j < t->size; ++j)
+				{
+					node* p = t->buckets[j].load(std::memory_order_acquire);
+					for (; p != NULL; p = p->next.load(std::memory_order_acquire))
+						proc(const_cast<const key_T&>(p->key), const_cast<const value_T&>(p->value));
+				}
+			}
+		}
+
+		//////////////////////////////////////////////////////
+		// modifying functions, these lock one shard
+
+		// associates the value with the key, replacing any previous value
+		void add(const key_T& key, const value_T& x)
+		{
+			u8 h = hash(key);
+			shard& s = get_shard(h);
+			std::lock_guard<std::mutex> lock(s.mutex);
+			table* t = s.tbl.load(std::memory_order_relaxed);
+			std::atomic<node*>* link = find_link(t, h, key);
+			node* old = link->load(std::memory_order_relaxed);
+			if (old != NULL)
+			{
+				node* p = new node(key, x, h, old->next.load(std::memory_order_relaxed));
+				link->store(p, std::memory_order_release);
+				retire(s, old, &delete_node);
+				return;
+			}
+			insert(s, t, h, key, x);
+		}
+
+		// adds the entry unless the key is already present, returns true if it was added
+		bool insert_if_absent(const key_T& key, const value_T& x)
+		{
+			if (contains(key))
+				return false;
+			u8 h = hash(key);
+			shard& s = get_shard(h);
+			std::lock_guard<std::mutex> lock(s.mutex);
+			table* t = s.tbl.load(std::memory_order_relaxed);
+			if (find_node(t, h, key) != NULL)
+				return false;
+			insert(s, t, h, key, x);
+			return true;
+		}
+
+		// returns the value associated with the key, first adding x if there is none
+		value_T find_or_insert(const key_T& key, const value_T& x)
+		{
+			value_T ret;
+			if (find(key, ret))
+				return ret;
+			u8 h = hash(key);
+			shard& s = get_shard(h);
+			std::lock_guard<std::mutex> lock(s.mutex);
+			table* t = s.tbl.load(std::memory_order_relaxed);
+			node* p = find_node(t, h, key);
+			if (p != NULL)
+				return p->value;
+			insert(s, t, h, key, x);
+			return x;
+		}
+
+		// removes the entry with the key, returns false if there was none
+		bool erase(const key_T& key)
+		{
+			u8 h = hash(key);
+			shard& s = get_shard(h);
+			std::lock_guard<std::mutex> lock(s.mutex);
+			std::atomic<node*>* link = find_link(s.tbl.load(std::memory_order_relaxed), h, key);
+			node* p = link->load(std::memory_order_relaxed);
+			if (p == NULL)
+				return false;
+			link->store(p->next.load(std::memory_order_relaxed), std::memory_order_release);
+			s.count.fetch_sub(1, std::memory_order_relaxed);
+			retire(s, p, &delete_node);
+			return true;
+		}
+
+		u8 hash(const key_T& key) const
+		{
+			static hash_T hasher;
+			return hasher(key);
+		}
+
+	private:
+
+		struct node
+		{
+			node(const key_T& k, const value_T& v, u8 h, node* n)
+				: key(k), value(v), hash(h), next(n)
+			{ }
+			const key_T key;
+			const value_T value;
+			const u8 hash;
+			std::atomic<node*> next;
+		};
+
+		struct table
+		{
+			table(size_t n) : size(n)
+			{
+				buckets = new std::atomic<node*>[n];
+				for (size_t i = 0; i < n; ++i)
+					buckets[i].store(NULL, std::memory_order_relaxed);
+			}
+			~table()
+			{
+				delete[] buckets;
+			}
+			size_t size;
+			std::atomic<node*>* buckets;
+		};
+
+		// an object waiting to be freed
+		struct retired
+		{
+			void* p;
+			void (*deleter)(void*);
+			u8 epoch;
+		};
+
+		// shards are aligned to a cache line so that their locks don't share one
+		struct alignas(64) shard
+		{
+			shard() : count(0), nReclaimAt(reclaim_threshold)
+			{
+				tbl.store(new table(initial_buckets));
+			}
+			std::mutex mutex;
+			std::atomic<table*> tbl;
+			std::atomic<size_t> count;
+			// the following are only used while holding the lock
+			stack<retired> garbage;
+			size_t nReclaimAt;
+		};
+
+		static void delete_node(void* p)
+		{
+			delete static_cast<node*>(p);
+		}
+
+		static void delete_table(void* p)
+		{
+			delete static_cast<table*>(p);
+		}
+
+		static void delete_chain(node* p)
+		{
+			while (p != NULL)
+			{
+				node* tmp = p->next.load(std::memory_order_relaxed);
+				delete p;
+				p = tmp;
+			}
+		}
+
+		// the high bits of the hash code choose the shard, the low bits the bucket
+		shard& get_shard(u8 h)
+		{
+			return mpShards[(size_t)(h >> 40) & (mnShards - 1)];
+		}
+
+		static node* find_node(table* t, u8 h, const key_T& key)
+		{
+			node* p = t->buckets[h & (t->size - 1)].load(std::memory_order_acquire);
+			for (; p != NULL; p = p->next.load(std::memory_order_acquire))
+				if (p->hash == h && p->key == key)
+					return p;
+			return NULL;
+		}
+
+		// returns the link pointing to the node with the key, or the link at the end of
+		// its chain. Only called with the lock of the shard held.
+		static std::atomic<node*>* find_link(table* t, u8 h, const key_T& key)
+		{
+			std::atomic<node*>* link = &(t->buckets[h & (t->size - 1)]);
+			node* p = link->load(std::memory_order_relaxed);
+			while (p != NULL && !(p->hash == h && p->key == key))
+			{
+				link = &(p->next);
+				p = link->load(std::memory_order_relaxed);
+			}
+			return link;
+		}
+
+		// adds a node for a key that is not present, at the head of its chain
+		void insert(shard& s, table* t, u8 h, const key_T& key, const value_T& x)
+		{
+			size_t n = s.count.load(std::memory_order_relaxed) + 1;
+			if (n > t->size)
+				t = grow(s, t);
+			std::atomic<node*>& head = t->buckets[h & (t->size - 1)];
+			head.store(new node(key, x, h, head.load(std::memory_order_relaxed)), std::memory_order_release);
+			s.count.store(n, std::memory_order_relaxed);
+		}
+
+		// copies the nodes into a table twice as big. Readers may still be walking the
+		// old chains, so the old nodes can't be relinked; they are retired instead.
+		table* grow(shard& s, table* t)
+		{
+			table* ret = new table(t->size * 2);
+			for (size_t i = 0; i < t->size; ++i)
+			{
+				for (node* p = t->buckets[i].load(std::memory_order_relaxed); p != NULL;
+					p = p->next.load(std::memory_order_relaxed))
+				{
+					std::atomic<node*>& head = ret->buckets[p->hash & (ret->size - 1)];
+					head.store(new node(p->key, p->value, p->hash, head.load(std::memory_order_relaxed)),
+						std::memory_order_relaxed);
+				}
+			}
+			s.tbl.store(ret, std::memory_order_release);
+			for (size_t i = 0; i < t->size; ++i)
+			{
+				node* p = t->buckets[i].load(std::memory_order_relaxed);
+				while (p != NULL)
+				{
+					node* tmp = p->next.load(std::memory_order_relaxed);
+					retire(s, p, &delete_node);
+					p = tmp;
+				}
+			}
+			retire(s, t, &delete_table);
+			return ret;
+		}
+
+		// frees the object once no reader can reach it. Only called with the lock
+		// of the shard held, after the object has been unlinked.
+		void retire(shard& s, void* p, void (*deleter)(void*))
+		{
+			epoch_domain& d = default_epoch_domain();
+			retired r;
+			r.p = p;
+			r.deleter = deleter;
+			r.epoch = d.current();
+			s.garbage.push(r);
+			if (s.garbage.count() < s.nReclaimAt)
+				return;
+			d.try_advance();
+			stack<retired> keep;
+			while (!s.garbage.is_empty())
+			{
+				retired x = s.garbage.pull();
+				if (d.is_safe(x.epoch))
+					x.deleter(x.p);
+				else
+					keep.push(x);
+			}
+			s.garbage.swap(keep);
+			// the objects that are kept are checked again after as many new ones
+			s.nReclaimAt = s.garbage.count() * 2 + reclaim_threshold;
+		}
+
+		// hide the copy constructor and assignment operator
+		concurrent_hash_map(const self&);
+		void operator=(const self&);
+
+		//////////////////////////////////////////////////////
+		// fields
+
+		size_t mnShards;
+		shard* mpShards;
+	};
+}
+
+#endif
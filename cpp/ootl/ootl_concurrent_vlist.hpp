@@ -0,0 +1,167 @@
+// Public Domain by Christopher Diggins
+// http://www.ootl.org
+//
+// An append-only vlist that can be read by many threads while one thread appends to it.
+// Since a vlist never relocates items, a reader can safely use any item that has been
+// published: the writer constructs an item and then atomically increments the published
+// count, and a new buffer is atomically stored in the buffer directory before any item
+// in it is published. Readers never take a lock and never see a partially constructed item.
+//
+// Buffers are only released by the destructor, so the container must outlive its readers
+// (e.g. by sharing it through a std::shared_ptr). Requires C++11 atomics.
+//
+// Note: unlike ootl::stack, items are indexed from the first item pushed.
+
+#ifndef OOTL_CONCURRENT_VLIST_HPP
+#define OOTL_CONCURRENT_VLIST_HPP
+
+#include <atomic>
+
+#include "ootl_vlist.hpp"
+
+namespace ootl
+{
+	template<typename T, typename Policy_T = default_vlist_policy, typename Alloc_T = malloc_vlist_allocator>
+	struct concurrent_vlist
+	{
+		static_assert(vlist_policy_traits<Policy_T>::geometric, "concurrent_vlist requires a geometric policy");
+
+		typedef concurrent_vlist self;
+		typedef T value_type;
+
+		// enough buffers to hold any number of items that can be indexed
+		static const size_t max_buffers = sizeof(size_t) * 8;
+
+		concurrent_vlist()
+			: mnCount(0), mnWriterCount(0)
+		{
+			for (size_t i = 0; i < max_buffers; ++i)
+				mDir[i].store(NULL, std::memory_order_relaxed);
+		}
+
+		~concurrent_vlist()
+		{
+			size_t n = mnWriterCount;
+			for (size_t k = 0; k < max_buffers; ++k)
+			{
+				T* p = mDir[k].load(std::memory_order_relaxed);
+				if (p == NULL)
+					break;
+				size_t nSize = buffer_size(k);
+				size_t nUsed = n < nSize ? n : nSize;
+				if (!is_trivially_destructible<T>::value)
+					for (size_t i = 0; i < nUsed; ++i)
+						p[i].~T();
+				n -= nUsed;
+				Alloc_T::deallocate(p, nSize * sizeof(T));
+			}
+		}
+
+		//////////////////////////////////////////////////////
+		// reader functions, these can be called from any thread
+
+		// the number of published items
+		size_t count() const
+		{
+			return mnCount.load(std::memory_order_acquire);
+		}
+		bool is_empty() const
+		{
+			return count() == 0;
+		}
+		// n must be less than a value previously returned by count()
+		const T& operator[](size_t n) const
+		{
+			size_t k = buffer_of(n);
+			const T* p = mDir[k].load(std::memory_order_acquire);
+			ootl_assert(p != NULL);
+			return p[n - buffer_index(k)];
+		}
+		// calls proc on each item that is published when foreach is called
+		template<typename Procedure>
+		void foreach(Procedure& proc) const
+		{
+			size_t n = count();
+			for (size_t k = 0; n > 0; ++k)
+			{
+				const T* p = mDir[k].load(std::memory_order_acquire);
+				size_t nSize = buffer_size(k);
+				const T* end = p + (n < nSize ? n : nSize);
+				n -= end - p;
+				while (p != end)
+					proc(*p++);
+			}
+		}
+
+		//////////////////////////////////////////////////////
+		// writer functions, only one thread at a time may call these
+
+		void push(const T& x)
+		{
+			new(next_slot()) T(x);
+			publish();
+		}
+#ifdef OOTL_HAS_MOVE
+		void push(T&& x)
+		{
+			new(next_slot()) T(std::move(x));
+			publish();
+		}
+		template<typename... Args_T>
+		void emplace(Args_T&&... args)
+		{
+			new(next_slot()) T(std::forward<Args_T>(args)...);
+			publish();
+		}
+#endif
+
+	private:
+
+		static size_t buffer_size(size_t k)
+		{
+			return Policy_T::initial_size() << k;
+		}
+		// the index of the first item in buffer k
+		static size_t buffer_index(size_t k)
+		{
+			return Policy_T::initial_size() * ((size_t(1) << k) - 1);
+		}
+		static size_t buffer_of(size_t n)
+		{
+			return floor_log2(n / Policy_T::initial_size() + 1);
+		}
+
+		// returns the memory for the next item, allocating and publishing
+		// a new buffer if needed
+		T* next_slot()
+		{
+			size_t n = mnWriterCount;
+			size_t k = buffer_of(n);
+			T* p = mDir[k].load(std::memory_order_relaxed);
+			if (p == NULL)
+			{
+				p = static_cast<T*>(Alloc_T::allocate(buffer_size(k) * sizeof(T)));
+				mDir[k].store(p, std::memory_order_release);
+			}
+			return p + (n - buffer_index(k));
+		}
+		void publish()
+		{
+			mnCount.store(++mnWriterCount, std::memory_order_release);
+		}
+
+		// hide the copy constructor and assignment operator
+		concurrent_vlist(const self&);
+		void operator=(const self&);
+
+		//////////////////////////////////////////////////////
+		// fields
+
+		std::atomic<T*> mDir[max_buffers];
+		std::atomic<size_t> mnCount;
+		// only accessed by the writer
+		size_t mnWriterCount;
+	};
+}
+
+#endif
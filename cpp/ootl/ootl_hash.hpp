@@ -4,21 +4,35 @@
 #ifndef OOTL_HASH_HPP
 #define OOTL_HASH_HPP
 
+#include <exception>
+#include <stdexcept>
+
 #include "ootl_stack.hpp"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OOTL_HAS_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(__AVX2__)
+#define OOTL_HAS_AVX2
+#include <immintrin.h>
+#endif
+
 namespace ootl
 {
 
 typedef unsigned char u1;
 typedef unsigned short u2;
 typedef unsigned long u4;
+typedef unsigned long long u8;
 
 #define get16bits(d) (*((const u2*)(d)))
 
 // Paul Hseih's hash algorithm
 // from http://www.azillionmonkeys.com/qed/hash.html
 
-u4 hseih_hash(const char* key, u4 len) 
+inline u4 hseih_hash(const char* key, u4 len) 
 {  
   u4 hash = len;
   u4 tmp;
@@ -64,20 +78,182 @@ u4 hseih_hash(const char* key, u4 len)
 
 #undef get16bits
 
+	/////////////////////////////////////////////////////////
+	// 64-bit hashing
+	//
+	// Based on wyhash by Wang Yi (public domain), https://github.com/wangyi-fudan/wyhash.
+	// The 64x64->128 bit multiply folds all of the bits of both operands into the low 
+	// bits of the result, so one multiply is enough to mix an integer key.
+
+	const u8 hash_secret0 = 0xa0761d6478bd642full;
+	const u8 hash_secret1 = 0xe7037ed1a0b428dbull;
+	const u8 hash_secret2 = 0x8ebc6af09c88c6e3ull;
+	const u8 hash_secret3 = 0x589965cc75374cc3ull;
+
+	// replaces a and b with the low and high halves of their 128 bit product
+	inline void hash_mul128(u8& a, u8& b)
+	{
+#if defined(__GNUC__) && defined(__SIZEOF_INT128__)
+		__uint128_t r = (__uint128_t)a * b;
+		a = (u8)r;
+		b = (u8)(r >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+		a = _umul128(a, b, &b);
+#else
+		u8 ha = a >> 32, hb = b >> 32, la = (unsigned int)a, lb = (unsigned int)b;
+		u8 rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+		u8 t = rl + (rm0 << 32);
+		u8 c = t < rl;
+		u8 lo = t + (rm1 << 32);
+		c += lo < t;
+		a = lo;
+		b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+	}
+
+	// multiplies a and b, and returns the two halves of the result xor'ed together
+	inline u8 hash_mum(u8 a, u8 b)
+	{
+		hash_mul128(a, b);
+		return a ^ b;
+	}
+
+	// reads unaligned little-endian words
+	inline u8 hash_read8(const u1* p) 
+	{ 
+		u8 v; 
+		memcpy(&v, p, 8); 
+		return v; 
+	}
+	inline u8 hash_read4(const u1* p) 
+	{ 
+		unsigned int v; 
+		memcpy(&v, p, 4); 
+		return v; 
+	}
+
+	// hashes len bytes at key
+	inline u8 wy_hash(const void* key, size_t len, u8 seed = 0)
+	{
+		const u1* p = static_cast<const u1*>(key);
+		seed ^= hash_mum(seed ^ hash_secret0, hash_secret1);
+		u8 a, b;
+		if (len <= 16)
+		{
+			if (len >= 4)
+			{
+				size_t n = (len >> 3) << 2;
+				a = (hash_read4(p) << 32) | hash_read4(p + n);
+				b = (hash_read4(p + len - 4) << 32) | hash_read4(p + len - 4 - n);
+			}
+			else if (len > 0)
+			{
+				a = ((u8)p[0] << 16) | ((u8)p[len >> 1] << 8) | p[len - 1];
+				b = 0;
+			}
+			else
+			{
+				a = b = 0;
+			}
+		}
+		else
+		{
+			size_t i = len;
+			if (i > 48)
+			{
+				u8 see1 = seed, see2 = seed;
+				do
+				{
+					seed = hash_mum(hash_read8(p) ^ hash_secret1, hash_read8(p + 8) ^ seed);
+					see1 = hash_mum(hash_read8(p + 16) ^ hash_secret2, hash_read8(p + 24) ^ see1);
+					see2 = hash_mum(hash_read8(p + 32) ^ hash_secret3, hash_read8(p + 40) ^ see2);
+					p += 48;
+					i -= 48;
+				}
+				while (i > 48);
+				seed ^= see1 ^ see2;
+			}
+			while (i > 16)
+			{
+				seed = hash_mum(hash_read8(p) ^ hash_secret1, hash_read8(p + 8) ^ seed);
+				i -= 16;
+				p += 16;
+			}
+			a = hash_read8(p + i - 16);
+			b = hash_read8(p + i - 8);
+		}
+		a ^= hash_secret1;
+		b ^= seed;
+		hash_mul128(a, b);
+		return hash_mum(a ^ hash_secret0 ^ len, b ^ hash_secret1);
+	}
+
+	// mixes an integer (or pointer) key
+	inline u8 hash_mix(u8 x)
+	{
+		return hash_mum(x ^ hash_secret0, hash_secret1);
+	}
+
+	// The default hasher hashes the bytes of the key. Keys with padding bytes need 
+	// their own hasher.
 	template<typename T>
 	struct hasher {
-	  u4 operator()(const T& x) const { 
-		return hseih_hash(reinterpret_cast<const char*>(&x), sizeof(T));
+	  u8 operator()(const T& x) const { 
+		return wy_hash(&x, sizeof(T));
 	  }  
 	};
 
 	template<>
 	struct hasher<const char*> {
-	  u4 operator()(const char* x) const { 
-		return hseih_hash(x, (u4)strlen(x));
+	  u8 operator()(const char* x) const { 
+		return wy_hash(x, strlen(x));
 	  }  
 	};
 
+	template<typename T>
+	struct hasher<T*> {
+	  u8 operator()(T* x) const { 
+		return hash_mix((u8)(size_t)x);
+	  }  
+	};
+
+#define OOTL_INTEGRAL_HASHER(T) \
+	template<> \
+	struct hasher<T> { \
+	  u8 operator()(T x) const { \
+		return hash_mix((u8)x); \
+	  } \
+	};
+
+	OOTL_INTEGRAL_HASHER(bool)
+	OOTL_INTEGRAL_HASHER(char)
+	OOTL_INTEGRAL_HASHER(signed char)
+	OOTL_INTEGRAL_HASHER(unsigned char)
+	OOTL_INTEGRAL_HASHER(short)
+	OOTL_INTEGRAL_HASHER(unsigned short)
+	OOTL_INTEGRAL_HASHER(int)
+	OOTL_INTEGRAL_HASHER(unsigned int)
+	OOTL_INTEGRAL_HASHER(long)
+	OOTL_INTEGRAL_HASHER(unsigned long)
+	OOTL_INTEGRAL_HASHER(long long)
+	OOTL_INTEGRAL_HASHER(unsigned long long)
+
+#undef OOTL_INTEGRAL_HASHER
+
+	// hashes n keys into out. Computing the hash codes of a batch up front lets a 
+	// lookup prefetch the slots of the following keys (see flat_hash_map::find_n).
+	template<typename T, typename hash_T>
+	void hash_n(const T* keys, size_t n, u8* out, const hash_T& h)
+	{
+		for (size_t i = 0; i < n; ++i)
+			out[i] = h(keys[i]);
+	}
+	template<typename T>
+	void hash_n(const T* keys, size_t n, u8* out)
+	{
+		hash_n(keys, n, out, hasher<T>());
+	}
+
 	template<typename first_T, typename second_T>
 	struct pair 
 	{
@@ -89,27 +265,129 @@ u4 hseih_hash(const char* key, u4 len)
 		{ }
 	};
 
+	// A hash_map is made of one or more layers, each an open addressing table. When the
+	// newest layer is saturated a bigger layer is added, and the entries of the previous 
+	// layer are migrated into the new one a few at a time on each insert. Lookups only 
+	// probe the older layer while a migration is in progress, and there are never more 
+	// than two layers. Unused slots are recognized by comparing their key to unused_key 
+	// (i.e. key_T()), and layers are zero-filled, so keys should be plain data types.
+	//
+	// Each layer has a small Bloom filter of the hash codes stored in it, so that most 
+	// lookups of missing keys are answered without probing the table.
+	//
+	// Erased entries are marked as dead (tombstones) but keep their slot, so that probe 
+	// sequences passing through them are not broken. A key is live in at most one slot:
+	// migrated entries are marked dead in the older layer. When too many slots of the 
+	// newest layer are dead, the live entries are copied into a fresh layer.
 	template<typename key_T, typename value_T, typename hash_T = hasher<key_T> >
-	struct hash_map : vlist<pair<key_T, value_T> >
+	struct hash_map
 	{
 		typedef pair<key_T, value_T> hash_pair;
 
-		stack<hash_pair> mData;
+		// the number of slots in the first layer
+		static const size_t initial_size = 8;
+
+		// the number of slots of the older layer migrated on each insert
+		static const size_t migrate_per_insert = 4;
+
+		// the number of Bloom filter bits per slot
+		static const size_t filter_bits = 8;
+
+		struct layer
+		{
+			layer(size_t n) 
+				: size(n), count(0), dead_count(0), prev(NULL)
+			{
+				slots = static_cast<hash_pair*>(calloc(n, sizeof(hash_pair)));
+				filter = static_cast<u1*>(calloc(n * filter_bits / 8, 1));
+				dead = static_cast<u1*>(calloc(n / 8 + 1, 1));
+				if (slots == NULL || filter == NULL || dead == NULL)
+				{
+					free(slots);
+					free(filter);
+					free(dead);
+					throw std::bad_alloc();
+				}
+			}
+			~layer() 
+			{
+				free(slots);
+				free(filter);
+				free(dead);
+			}
+			// the filter uses two bits per entry, the second one is taken from a 
+			// multiplicative rehash of the hash code
+			void add_to_filter(u8 hash_code)
+			{
+				size_t nBits = size * filter_bits;
+				size_t i = hash_code % nBits;
+				size_t j = rehash(hash_code) % nBits;
+				filter[i >> 3] |= (u1)(1 << (i & 7));
+				filter[j >> 3] |= (u1)(1 << (j & 7));
+			}
+			// false if no entry with the hash code was ever added to the layer
+			bool may_contain(u8 hash_code) const
+			{
+				size_t nBits = size * filter_bits;
+				size_t i = hash_code % nBits;
+				size_t j = rehash(hash_code) % nBits;
+				return (filter[i >> 3] & (1 << (i & 7))) && (filter[j >> 3] & (1 << (j & 7)));
+			}
+			static u8 rehash(u8 hash_code)
+			{
+				return (hash_code * 0x9E3779B97F4A7C15ull) >> 29;
+			}
+			bool is_dead(const hash_pair* x) const
+			{
+				size_t i = x - slots;
+				return (dead[i >> 3] & (1 << (i & 7))) != 0;
+			}
+			void set_dead(const hash_pair* x, bool b)
+			{
+				size_t i = x - slots;
+				if (b)
+				{
+					dead[i >> 3] |= (u1)(1 << (i & 7));
+					++dead_count;
+				}
+				else
+				{
+					dead[i >> 3] &= (u1)~(1 << (i & 7));
+					--dead_count;
+				}
+			}
+			size_t size;
+			// the number of used slots, including dead ones
+			size_t count;
+			size_t dead_count;
+			hash_pair* slots;
+			u1* filter;
+			u1* dead;
+			layer* prev;
+		};
+
+		layer* mpLast;
+		size_t mnMigrated;
 		size_t mnCount;
 		key_T unused_key;
 
-		hash_map() : mnCount(0), vlist(), unused_key()
+		hash_map() : mpLast(NULL), mnMigrated(0), mnCount(0), unused_key()
+		{
+			mpLast = new layer(initial_size);
+		}
+
+		~hash_map()
 		{
+			delete_layers();
 		}
-	
-		hash_pair* find_slot(u4 hash_code, const key_T& key, buffer* buff)
+
+		// returns the slot in the layer holding the key, or else the unused slot where 
+		// it would be inserted
+		hash_pair* find_slot(u8 hash_code, const key_T& key, layer* p)
 		{
-			if (buff == NULL) 
-				throw new std::exception("could not find key");
-			
 			// try first hash-result 
-			size_t nIndex = hash_code % buff->size;
-			hash_pair* ret = &(buff->begin[nIndex]);
+			size_t nIndex = hash_code % p->size;
+			hash_pair* ret = &(p->slots[nIndex]);
 			if (ret->mFirst == key) 
 				return ret;
 			
@@ -117,66 +395,686 @@ u4 hseih_hash(const char* key, u4 len)
 			size_t nStep = 1;
 			while (ret->mFirst != unused_key) 
 			{
-				nIndex = (nIndex + (nStep * nStep)) % buff->size;
-				ret = &(buff->begin[nIndex]);		
+				nIndex = (nIndex + (nStep * nStep)) % p->size;
+				ret = &(p->slots[nIndex]);		
 				if (ret->mFirst == key) 
 					return ret;
-
-				// TEMP: this assertion is just for testing.
-				//assert(nStep <= 5 && "too many collisions");
-
 				++nStep;
 			}
-			
-			// recursive call
-			ret = find_slot(hash_code, key, buff->prev);
-			assert(ret->mFirst == key);
 			return ret;
 		}	
 
 		bool saturated()
 		{
-			if (get_last_buffer() == NULL)
-				return true;
-			return (get_last_buffer()->size / 5 * 3) < mnCount;
+			return (mpLast->size / 5 * 3) < mpLast->count + 1;
 		}
 
+		// associates the value with the key, replacing any previous value
 		void add(const key_T& k, const value_T& v)
 		{
 			assert(k != unused_key);
-			++mnCount;
-			if (saturated())
+			u8 h = hash(k);
+			hash_pair* x = find_live(h, k);
+			if (x != NULL)
 			{
-				mnCount = 1;
-				add_buffer();
+				x->mSecond = v;
+				return;
 			}
-			hash_pair* tmp = find_slot(hash_T()(k), unused_key, get_last_buffer());
-			assert(tmp->mFirst == unused_key);
-			tmp->mFirst = k; 
-			tmp->mSecond = v;
-			//assert(operator[](k) == v);			
+			if (saturated())
+				grow();
+			insert(mpLast, h, k, v);
+			migrate(migrate_per_insert);
 		}
 		
-		u4 hash(const key_T& key)
+		u8 hash(const key_T& key)
 		{
 			static hash_T hasher;
 			return hasher(key);
 		}
 
+		// returns a pointer to the value associated with the key, or NULL
+		value_T* find(const key_T& key)
+		{
+			if (key == unused_key)
+				return NULL;
+			hash_pair* x = find_live(hash(key), key);
+			return x == NULL ? NULL : &(x->mSecond);
+		}
+
+		bool contains(const key_T& key)
+		{
+			return find(key) != NULL;
+		}
+
+		// throws if the key is not found, use find() when a miss is expected
 		value_T& operator[](const key_T& key)
 		{
-			return find_slot(hash(key), key, get_last_buffer())->mSecond;
+			value_T* ret = find(key);
+			if (ret == NULL)
+				throw std::runtime_error("could not find key");
+			return *ret;
+		}
+
+		// removes the entry with the key, returns false if there was none 
+		bool erase(const key_T& key)
+		{
+			if (key == unused_key)
+				return false;
+			layer* p;
+			hash_pair* x = find_live(hash(key), key, &p);
+			if (x == NULL)
+				return false;
+			p->set_dead(x, true);
+			--mnCount;
+			if (p == mpLast && mpLast->dead_count > mpLast->size / 4)
+				rebuild(size_for(mnCount * 2));
+			return true;
+		}
+
+		size_t count() const
+		{
+			return mnCount;
+		}
+
+		bool is_empty() const
+		{
+			return mnCount == 0;
+		}
+
+		// calls proc on each live entry (a hash_pair), in no particular order
+		template<typename Procedure>
+		void foreach(Procedure& proc)
+		{
+			for (layer* p = mpLast; p != NULL; p = p->prev)
+			{
+				for (size_t i = 0; i < p->size; ++i)
+				{
+					hash_pair& x = p->slots[i];
+					if (x.mFirst != unused_key && !p->is_dead(&x))
+						proc(x);
+				}
+			}
+		}
+
+		// finishes any migration in progress, so that a lookup only probes one table
+		void compact()
+		{
+			if (mpLast->prev != NULL)
+				migrate(mpLast->prev->size);
+		}
+
+		// makes room for n entries in a single layer, so that they can be added 
+		// without growing
+		void reserve(size_t n)
+		{
+			compact();
+			if (mpLast->size / 5 * 3 >= n + mpLast->dead_count)
+				return;
+			rebuild(size_for(n));
+		}
+
+		// removes all entries, and releases all but a small layer
+		void clear()
+		{
+			delete_layers();
+			mpLast = new layer(initial_size);
+			mnMigrated = 0;
+			mnCount = 0;
+		}
+
+		// replaces the contents with n pairs, sizing the table once. If a key occurs 
+		// more than once the last value is kept. 
+		void build(const hash_pair* pairs, size_t n)
+		{
+			delete_layers();
+			mpLast = new layer(size_for(n));
+			mnMigrated = 0;
+			mnCount = 0;
+			for (const hash_pair* end = pairs + n; pairs != end; ++pairs)
+			{
+				assert(pairs->mFirst != unused_key);
+				u8 h = hash(pairs->mFirst);
+				hash_pair* x = find_slot(h, pairs->mFirst, mpLast);
+				if (x->mFirst == pairs->mFirst)
+					x->mSecond = pairs->mSecond;
+				else
+					insert(mpLast, h, pairs->mFirst, pairs->mSecond);
+			}
 		}
 
 	private:
 
+		// returns the live entry with the key, or NULL
+		hash_pair* find_live(u8 hash_code, const key_T& key, layer** owner = NULL)
+		{
+			for (layer* p = mpLast; p != NULL; p = p->prev)
+			{
+				if (!p->may_contain(hash_code))
+					continue;
+				hash_pair* ret = find_slot(hash_code, key, p);
+				if (ret->mFirst == key && !p->is_dead(ret))
+				{
+					if (owner != NULL)
+						*owner = p;
+					return ret;
+				}
+			}
+			return NULL;
+		}
+
+		// inserts a key that is not live in the map, reusing its dead slot if the 
+		// layer has one
+		void insert(layer* p, u8 hash_code, const key_T& k, const value_T& v)
+		{
+			hash_pair* tmp = find_slot(hash_code, k, p);
+			if (tmp->mFirst == k)
+			{
+				assert(p->is_dead(tmp));
+				p->set_dead(tmp, false);
+			}
+			else
+			{
+				assert(tmp->mFirst == unused_key);
+				tmp->mFirst = k; 
+				++p->count;
+				p->add_to_filter(hash_code);
+			}
+			tmp->mSecond = v;
+			++mnCount;
+		}
+
+		// the size of the smallest layer that can hold n entries without saturating
+		static size_t size_for(size_t n)
+		{
+			size_t ret = initial_size;
+			while (ret / 5 * 3 < n)
+				ret *= 2;
+			return ret;
+		}
+
+		// adds a layer big enough for all of the live entries at a load of 30%, so 
+		// that the migration is finished long before the new layer is saturated
+		void grow()
+		{
+			compact();
+			add_layer(size_for(mnCount * 2));
+		}
+
+		// moves all live entries into a new layer of n slots
+		void rebuild(size_t n)
+		{
+			compact();
+			add_layer(n);
+			compact();
+		}
+
+		void add_layer(size_t n)
+		{
+			layer* tmp = new layer(n);
+			tmp->prev = mpLast;
+			mpLast = tmp;
+			mnMigrated = 0;
+		}
+
+		// moves the live entries of up to n slots of the older layer into the newest 
+		// one, and deletes the older layer once it is done
+		void migrate(size_t n)
+		{
+			layer* old = mpLast->prev;
+			if (old == NULL)
+				return;
+			while (n-- > 0 && mnMigrated < old->size)
+			{
+				hash_pair& x = old->slots[mnMigrated++];
+				if (x.mFirst == unused_key || old->is_dead(&x))
+					continue;
+				--mnCount;
+				insert(mpLast, hash(x.mFirst), x.mFirst, x.mSecond);
+				old->set_dead(&x, true);
+			}
+			if (mnMigrated == old->size)
+			{
+				mpLast->prev = NULL;
+				mnMigrated = 0;
+				delete old;
+			}
+		}
+
+		void delete_layers()
+		{
+			while (mpLast != NULL)
+			{
+				layer* tmp = mpLast;
+				mpLast = mpLast->prev;
+				delete tmp;
+			}
+		}
+
 		// Hide the copy constructor
 		hash_map(const hash_map& x) { };
 
 		// Hide the assignment operator
 		void operator=(const hash_map& x) { };
+	};
+
+	/////////////////////////////////////////////////////////
+	// flat_hash_map
+	//
+	// An open addressing table where each slot has a control byte: either empty, deleted, 
+	// or the low 7 bits of the hash code of the key in the slot. Slots are probed in groups
+	// of 16, and with SSE2 the control bytes of a whole group are compared to the tag of 
+	// the key with a single instruction. With AVX2 the groups have 32 slots instead. Keys 
+	// are only compared when the tags match, which is almost always a hit. Keys and values
+	// are stored in separate arrays, so that a probe only touches the control bytes and 
+	// the keys. 
+	//
+	// Unlike hash_map there are no restrictions on the key and value types.
+
+	struct flat_hash_group
+	{
+		static const size_t size = 16;
+		static const u1 empty = 0x80;
+		static const u1 deleted = 0xFE;
+
+		flat_hash_group(const u1* p) 
+#ifdef OOTL_HAS_SSE2
+			: ctrl(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)))
+#else
+			: ctrl(p)
+#endif
+		{ }
+
+#ifdef OOTL_HAS_SSE2
+		// a bit is set for each slot with the tag
+		u4 match(u1 tag) const {
+			return (u4)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char)tag)));
+		}
+		// a bit is set for each empty slot
+		u4 match_empty() const {
+			return match(empty);
+		}
+		// a bit is set for each empty or deleted slot, i.e. the ones with the high bit set
+		u4 match_free() const {
+			return (u4)_mm_movemask_epi8(ctrl);
+		}
+		__m128i ctrl;
+#else
+		u4 match(u1 tag) const {
+			u4 ret = 0;
+			for (size_t i = 0; i < size; ++i)
+				if (ctrl[i] == tag)
+					ret |= 1 << i;
+			return ret;
+		}
+		u4 match_empty() const {
+			return match(empty);
+		}
+		u4 match_free() const {
+			u4 ret = 0;
+			for (size_t i = 0; i < size; ++i)
+				if (ctrl[i] & 0x80)
+					ret |= 1 << i;
+			return ret;
+		}
+		const u1* ctrl;
+#endif
+
+		// the index of the lowest set bit of a non-zero mask
+		static size_t first(u4 mask) {
+			return floor_log2(mask & (~mask + 1));
+		}
+	};
+
+#ifdef OOTL_HAS_AVX2
+	// A group of 32 slots, used by flat_hash_map when AVX2 is available. mapped_hash_map
+	// always uses groups of 16, since the group size is part of its file format.
+	struct flat_hash_group32
+	{
+		static const size_t size = 32;
+		static const u1 empty = flat_hash_group::empty;
+		static const u1 deleted = flat_hash_group::deleted;
+
+		flat_hash_group32(const u1* p) 
+			: ctrl(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)))
+		{ }
+
+		u4 match(u1 tag) const {
+			return (u4)_mm256_movemask_epi8(_mm256_cmpeq_epi8(ctrl, _mm256_set1_epi8((char)tag)));
+		}
+		u4 match_empty() const {
+			return match(empty);
+		}
+		u4 match_free() const {
+			return (u4)_mm256_movemask_epi8(ctrl);
+		}
+		static size_t first(u4 mask) {
+			return flat_hash_group::first(mask);
+		}
+		__m256i ctrl;
+	};
+
+	typedef flat_hash_group32 flat_hash_map_group;
+#else
+	typedef flat_hash_group flat_hash_map_group;
+#endif
+
+	template<typename key_T, typename value_T, typename hash_T = hasher<key_T> >
+	struct flat_hash_map
+	{
+		typedef flat_hash_map self;
+		typedef flat_hash_map_group group;
+
+		// the table never has more than 7/8 of its slots used (including deleted ones),
+		// so that every probe sequence reaches an empty slot
+		static size_t max_used(size_t nCapacity) {
+			return nCapacity / 8 * 7;
+		}
+
+		flat_hash_map() 
+			: mpCtrl(NULL), mpKeys(NULL), mpValues(NULL), mnCapacity(0), mnCount(0), mnUsed(0)
+		{
+			allocate(group::size);
+		}
+
+		~flat_hash_map()
+		{
+			destroy_all();
+			deallocate();
+		}
+
+		// associates the value with the key, replacing any previous value
+		void add(const key_T& k, const value_T& v)
+		{
+			u8 h = hash(k);
+			size_t i = find_index(h, k);
+			if (i != npos())
+			{
+				mpValues[i] = v;
+				return;
+			}
+			if (mnUsed + 1 > max_used(mnCapacity))
+				make_room();
+			i = insert_index(h);
+			new(mpKeys + i) key_T(k);
+			new(mpValues + i) value_T(v);
+		}
+
+		// returns a pointer to the value associated with the key, or NULL
+		value_T* find(const key_T& key)
+		{
+			size_t i = find_index(hash(key), key);
+			return i == npos() ? NULL : mpValues + i;
+		}
+
+		// looks up n keys, storing a pointer to each value (or NULL) in out. The keys 
+		// are hashed in batches, and the first group of each key is prefetched before 
+		// any of them is probed, so the cache misses of a batch overlap.
+		void find_n(const key_T* keys, size_t n, value_T** out)
+		{
+			static const size_t batch = 16;
+			static hash_T hasher;
+			u8 codes[batch];
+			while (n > 0)
+			{
+				size_t m = n < batch ? n : batch;
+				hash_n(keys, m, codes, hasher);
+				for (size_t i = 0; i < m; ++i)
+					ootl_prefetch(mpCtrl + first_group(codes[i]) * group::size);
+				for (size_t i = 0; i < m; ++i)
+				{
+					size_t j = find_index(codes[i], keys[i]);
+					out[i] = j == npos() ? NULL : mpValues + j;
+				}
+				keys += m;
+				out += m;
+				n -= m;
+			}
+		}
+
+		bool contains(const key_T& key)
+		{
+			return find(key) != NULL;
+		}
+
+		// throws if the key is not found, use find() when a miss is expected
+		value_T& operator[](const key_T& key)
+		{
+			value_T* ret = find(key);
+			if (ret == NULL)
+				throw std::runtime_error("could not find key");
+			return *ret;
+		}
+
+		// removes the entry with the key, returns false if there was none 
+		bool erase(const key_T& key)
+		{
+			size_t i = find_index(hash(key), key);
+			if (i == npos())
+				return false;
+			mpKeys[i].~key_T();
+			mpValues[i].~value_T();
+			mpCtrl[i] = group::deleted;
+			--mnCount;
+			return true;
+		}
+
+		size_t count() const
+		{
+			return mnCount;
+		}
+
+		bool is_empty() const
+		{
+			return mnCount == 0;
+		}
+
+		// makes room for n entries, so that they can be added without rehashing
+		void reserve(size_t n)
+		{
+			if (n > max_used(mnCapacity) - (mnUsed - mnCount))
+				rehash(capacity_for(n));
+		}
+
+		// removes all entries, the memory is kept
+		void clear()
+		{
+			destroy_all();
+			memset(mpCtrl, group::empty, mnCapacity);
+			mnCount = 0;
+			mnUsed = 0;
+		}
+
+		// calls proc(key, value) on each entry, in no particular order
+		template<typename Procedure>
+		void foreach(Procedure& proc)
+		{
+			for (size_t i = 0; i < mnCapacity; ++i)
+				if (!(mpCtrl[i] & 0x80))
+					proc(const_cast<const key_T&>(mpKeys[i]), mpValues[i]);
+		}
+
+		u8 hash(const key_T& key)
+		{
+			static hash_T hasher;
+			return hasher(key);
+		}
+
+	private:
+
+		static size_t npos() {
+			return size_t(-1);
+		}
+
+		// the low 7 bits of the hash code are stored in the control byte, the 
+		// remaining bits choose the first group
+		static u1 tag(u8 hash_code) {
+			return (u1)(hash_code & 0x7F);
+		}
 
+		size_t first_group(u8 hash_code) const {
+			return (size_t)(hash_code >> 7) & (mnCapacity / group::size - 1);
+		}
 
+		// the groups are probed in triangular order (g, g+1, g+3, g+6, ...) which 
+		// visits every group since their number is a power of two
+		size_t find_index(u8 hash_code, const key_T& key) const
+		{
+			size_t nMask = mnCapacity / group::size - 1;
+			size_t g = first_group(hash_code);
+			u1 t = tag(hash_code);
+			for (size_t nStep = 1; ; ++nStep)
+			{
+				group grp(mpCtrl + g * group::size);
+				u4 m = grp.match(t);
+				while (m != 0)
+				{
+					size_t i = g * group::size + group::first(m);
+					if (mpKeys[i] == key)
+						return i;
+					m &= m - 1;
+				}
+				if (grp.match_empty() != 0)
+					return npos();
+				g = (g + nStep) & nMask;
+			}
+		}
+
+		// marks the first free slot in the probe sequence as used, and returns its index
+		size_t insert_index(u8 hash_code)
+		{
+			size_t nMask = mnCapacity / group::size - 1;
+			size_t g = first_group(hash_code);
+			for (size_t nStep = 1; ; ++nStep)
+			{
+				u4 m = group(mpCtrl + g * group::size).match_free();
+				if (m != 0)
+				{
+					size_t i = g * group::size + group::first(m);
+					if (mpCtrl[i] == group::empty)
+						++mnUsed;
+					mpCtrl[i] = tag(hash_code);
+					++mnCount;
+					return i;
+				}
+				g = (g + nStep) & nMask;
+			}
+		}
+
+		// called when the table is full. Deleted slots are only reclaimed at the same 
+		// capacity when most used slots are deleted, so that the next rehash is at 
+		// least max_used/2 inserts away, otherwise erasing and adding entries at 
+		// a steady count would rebuild the whole table every few inserts.
+		void make_room()
+		{
+			if (mnCount + 1 > max_used(mnCapacity) / 2)
+				rehash(mnCapacity * 2);
+			else
+				rehash(mnCapacity);
+		}
+
+		// the smallest capacity that can hold n entries
+		static size_t capacity_for(size_t n)
+		{
+			size_t ret = group::size;
+			while (max_used(ret) < n)
+				ret *= 2;
+			return ret;
+		}
+
+		void allocate(size_t nCapacity)
+		{
+			mpCtrl = static_cast<u1*>(malloc(nCapacity));
+			mpKeys = static_cast<key_T*>(malloc(nCapacity * sizeof(key_T)));
+			mpValues = static_cast<value_T*>(malloc(nCapacity * sizeof(value_T)));
+			if (mpCtrl == NULL || mpKeys == NULL || mpValues == NULL)
+			{
+				deallocate();
+				throw std::bad_alloc();
+			}
+			memset(mpCtrl, group::empty, nCapacity);
+			mnCapacity = nCapacity;
+		}
+
+		void deallocate()
+		{
+			free(mpCtrl);
+			free(mpKeys);
+			free(mpValues);
+			mpCtrl = NULL;
+			mpKeys = NULL;
+			mpValues = NULL;
+			mnCapacity = 0;
+		}
+
+		void destroy_all()
+		{
+			if (is_trivially_destructible<key_T>::value && is_trivially_destructible<value_T>::value)
+				return;
+			for (size_t i = 0; i < mnCapacity; ++i)
+			{
+				if (!(mpCtrl[i] & 0x80))
+				{
+					mpKeys[i].~key_T();
+					mpValues[i].~value_T();
+				}
+			}
+		}
+
+		// moves the entries into a new table, which also drops the deleted slots
+		void rehash(size_t nCapacity)
+		{
+			u1* pCtrl = mpCtrl;
+			key_T* pKeys = mpKeys;
+			value_T* pValues = mpValues;
+			size_t nOld = mnCapacity;
+			mpCtrl = NULL;
+			mpKeys = NULL;
+			mpValues = NULL;
+			try
+			{
+				allocate(nCapacity);
+			}
+			catch (...)
+			{
+				mpCtrl = pCtrl;
+				mpKeys = pKeys;
+				mpValues = pValues;
+				mnCapacity = nOld;
+				throw;
+			}
+			mnCount = 0;
+			mnUsed = 0;
+			for (size_t i = 0; i < nOld; ++i)
+			{
+				if (pCtrl[i] & 0x80)
+					continue;
+				size_t j = insert_index(hash(pKeys[i]));
+#ifdef OOTL_HAS_MOVE
+				new(mpKeys + j) key_T(std::move(pKeys[i]));
+				new(mpValues + j) value_T(std::move(pValues[i]));
+#else
+				new(mpKeys + j) key_T(pKeys[i]);
+				new(mpValues + j) value_T(pValues[i]);
+#endif
+				pKeys[i].~key_T();
+				pValues[i].~value_T();
+			}
+			free(pCtrl);
+			free(pKeys);
+			free(pValues);
+		}
+
+		// Hide the copy constructor and assignment operator
+		flat_hash_map(const self& x);
+		void operator=(const self& x);
+
+		u1* mpCtrl;
+		key_T* mpKeys;
+		value_T* mpValues;
+		size_t mnCapacity;
+		size_t mnCount;
+		// the number of full and deleted slots
+		size_t mnUsed;
 	};
 }
 
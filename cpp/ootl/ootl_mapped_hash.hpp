@@ -0,0 +1,580 @@
+// Public Domain by Christopher Diggins
+// http://www.ootl.org
+//
+// A hash map stored in a memory mapped file. Opening a file does not read or parse it:
+// the table is used in place, and pages are loaded by the operating system as they are
+// probed. Entries can be added to a file opened for writing, which grows and rehashes
+// the file when it is full.
+//
+// A rehash builds the new table in a temporary file (the path of the map followed by
+// ".tmp") which then replaces the map file, so a rehash that fails or is interrupted
+// leaves the old table intact. Other changes are made in place: if the process stops
+// while adding an entry, that entry may be partly written, and changes that were not
+// followed by sync() may be lost if the machine stops.
+//
+// The table uses the same control bytes and group probing as ootl::flat_hash_map. Keys
+// and values are written as raw bytes, so they must be plain data types without pointers,
+// and a file can only be read on a machine with the same byte order. The hasher must
+// give the same result in every run (the default hashers do, except for pointer keys).
+//
+// File layout, all integers are in native byte order:
+//
+//    0  char[8]   magic "ootlhash"
+//    8  u32       version (mapped_hash_version)
+//   12  u32       sizeof(key_T)
+//   16  u32       sizeof(value_T)
+//   20  u32       reserved, zero
+//   24  u64       capacity, the number of slots (a power of two)
+//   32  u64       count, the number of entries
+//   40  ...       zero up to 64
+//   64  u8[capacity]  control bytes
+//   then key_T[capacity] and value_T[capacity], each starting at a multiple of 8
+
+#ifndef OOTL_MAPPED_HASH_HPP
+#define OOTL_MAPPED_HASH_HPP
+
+#include <stdexcept>
+#include <cstdio>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "ootl_hash.hpp"
+#include "ootl_string.hpp"
+
+namespace ootl
+{
+	/////////////////////////////////////////////////////////
+	// mapped_file
+
+	// a whole file mapped into memory
+	struct mapped_file
+	{
+		mapped_file()
+			: mpData(NULL), mnSize(0), mbReadOnly(true)
+#ifdef _WIN32
+			, mhFile(INVALID_HANDLE_VALUE), mhMapping(NULL)
+#else
+			, mnFile(-1)
+#endif
+		{ }
+
+		~mapped_file()
+		{
+			close();
+		}
+
+		// opens an existing file, or creates an empty one
+		void open(const char* path, bool bReadOnly, bool bCreate)
+		{
+			close();
+			mbReadOnly = bReadOnly;
+#ifdef _WIN32
+			mhFile = CreateFileA(path, GENERIC_READ | (bReadOnly ? 0 : GENERIC_WRITE), FILE_SHARE_READ,
+				NULL, bCreate ? CREATE_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+			if (mhFile == INVALID_HANDLE_VALUE)
+				throw std::runtime_error("failed to open file");
+			LARGE_INTEGER n;
+			if (!GetFileSizeEx(mhFile, &n))
+			{
+				close();
+				throw std::runtime_error("failed to compute file size");
+			}
+			mnSize = (size_t)n.QuadPart;
+#else
+			mnFile = ::open(path, bReadOnly ? O_RDONLY : (O_RDWR | (bCreate ? O_CREAT | O_TRUNC : 0)), 0644);
+			if (mnFile < 0)
+				throw std::runtime_error("failed to open file");
+			struct stat tmp;
+			if (fstat(mnFile, &tmp) != 0)
+			{
+				close();
+				throw std::runtime_error("failed to compute file size");
+			}
+			mnSize = (size_t)tmp.st_size;
+#endif
+			map();
+		}
+
+		// changes the size of the file, the data may move
+		void resize(size_t n)
+		{
+			ootl_assert(!mbReadOnly);
+			unmap();
+#ifdef _WIN32
+			LARGE_INTEGER tmp;
+			tmp.QuadPart = (LONGLONG)n;
+			if (!SetFilePointerEx(mhFile, tmp, NULL, FILE_BEGIN) || !SetEndOfFile(mhFile))
+				throw std::runtime_error("failed to resize file");
+#else
+			if (ftruncate(mnFile, (off_t)n) != 0)
+				throw std::runtime_error("failed to resize file");
+#endif
+			mnSize = n;
+			map();
+		}
+
+		// writes modified pages to disk
+		void sync()
+		{
+			if (mpData == NULL || mbReadOnly)
+				return;
+#ifdef _WIN32
+			FlushViewOfFile(mpData, 0);
+			FlushFileBuffers(mhFile);
+#else
+			msync(mpData, mnSize, MS_SYNC);
+#endif
+		}
+
+		void close()
+		{
+			unmap();
+#ifdef _WIN32
+			if (mhFile != INVALID_HANDLE_VALUE)
+				CloseHandle(mhFile);
+			mhFile = INVALID_HANDLE_VALUE;
+#else
+			if (mnFile >= 0)
+				::close(mnFile);
+			mnFile = -1;
+#endif
+			mnSize = 0;
+		}
+
+		bool is_open() const
+		{
+#ifdef _WIN32
+			return mhFile != INVALID_HANDLE_VALUE;
+#else
+			return mnFile >= 0;
+#endif
+		}
+
+		u1* data() const { return mpData; }
+		size_t size() const { return mnSize; }
+		bool is_read_only() const { return mbReadOnly; }
+
+		// renames a file, replacing any file with the new name. Neither file may be open.
+		static void replace(const char* from, const char* to)
+		{
+#ifdef _WIN32
+			if (!MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+				throw std::runtime_error("failed to replace file");
+#else
+			if (::rename(from, to) != 0)
+				throw std::runtime_error("failed to replace file");
+#endif
+		}
+
+	private:
+
+		// empty files are not mapped
+		void map()
+		{
+			if (mnSize == 0)
+				return;
+#ifdef _WIN32
+			mhMapping = CreateFileMappingA(mhFile, NULL, mbReadOnly ? PAGE_READONLY : PAGE_READWRITE, 0, 0, NULL);
+			if (mhMapping == NULL)
+				throw std::runtime_error("failed to map file");
+			mpData = static_cast<u1*>(MapViewOfFile(mhMapping, mbReadOnly ? FILE_MAP_READ : FILE_MAP_WRITE, 0, 0, mnSize));
+			if (mpData == NULL)
+			{
+				CloseHandle(mhMapping);
+				mhMapping = NULL;
+				throw std::runtime_error("failed to map file");
+			}
+#else
+			void* p = mmap(NULL, mnSize, PROT_READ | (mbReadOnly ? 0 : PROT_WRITE), MAP_SHARED, mnFile, 0);
+			if (p == MAP_FAILED)
+				throw std::runtime_error("failed to map file");
+			mpData = static_cast<u1*>(p);
+#endif
+		}
+
+		void unmap()
+		{
+			if (mpData == NULL)
+				return;
+#ifdef _WIN32
+			UnmapViewOfFile(mpData);
+			CloseHandle(mhMapping);
+			mhMapping = NULL;
+#else
+			munmap(mpData, mnSize);
+#endif
+			mpData = NULL;
+		}
+
+		// hide the copy constructor and assignment operator
+		mapped_file(const mapped_file&);
+		void operator=(const mapped_file&);
+
+		u1* mpData;
+		size_t mnSize;
+		bool mbReadOnly;
+#ifdef _WIN32
+		HANDLE mhFile;
+		HANDLE mhMapping;
+#else
+		int mnFile;
+#endif
+	};
+
+	/////////////////////////////////////////////////////////
+	// mapped_hash_map
+
+	// incremented whenever the file layout changes
+	const unsigned int mapped_hash_version = 1;
+
+	struct mapped_hash_header
+	{
+		char magic[8];
+		unsigned int version;
+		unsigned int key_size;
+		unsigned int value_size;
+		unsigned int reserved;
+		u8 capacity;
+		u8 count;
+	};
+
+	template<typename key_T, typename value_T, typename hash_T = hasher<key_T> >
+	struct mapped_hash_map
+	{
+		typedef mapped_hash_map self;
+		typedef flat_hash_group group;
+
+		static const size_t header_size = 64;
+
+		mapped_hash_map()
+			: mpCtrl(NULL), mpKeys(NULL), mpValues(NULL)
+		{ }
+
+		// the changes are written to disk by the operating system
+		~mapped_hash_map()
+		{
+			close();
+		}
+
+		// creates (or truncates) a file with room for n entries
+		void create(const char* path, size_t n = 0)
+		{
+			close();
+			mFile.open(path, false, true);
+			mPath = path;
+			initialize(capacity_for(n));
+		}
+
+		// opens an existing file for reading and adding entries
+		void open(const char* path)
+		{
+			close();
+			mFile.open(path, false, false);
+			mPath = path;
+			validate();
+		}
+
+		// opens an existing file, nothing is read until it is needed
+		void open_read_only(const char* path)
+		{
+			close();
+			mFile.open(path, true, false);
+			mPath = path;
+			validate();
+		}
+
+		void close()
+		{
+			mFile.close();
+			mpCtrl = NULL;
+			mpKeys = NULL;
+			mpValues = NULL;
+		}
+
+		// writes the changes to disk before returning
+		void sync()
+		{
+			mFile.sync();
+		}
+
+		bool is_open() const
+		{
+			return mFile.is_open();
+		}
+
+		// a map that is not open is empty
+		size_t count() const
+		{
+			if (!is_open())
+				return 0;
+			return (size_t)header()->count;
+		}
+
+		bool is_empty() const
+		{
+			return count() == 0;
+		}
+
+		// returns a pointer to the value associated with the key, or NULL
+		const value_T* find(const key_T& key) const
+		{
+			if (!is_open())
+				return NULL;
+			size_t i = find_index(hash(key), key);
+			return i == npos() ? NULL : mpValues + i;
+		}
+
+		bool contains(const key_T& key) const
+		{
+			return find(key) != NULL;
+		}
+
+		// throws if the key is not found, use find() when a miss is expected
+		const value_T& operator[](const key_T& key) const
+		{
+			const value_T* ret = find(key);
+			if (ret == NULL)
+				throw std::runtime_error("could not find key");
+			return *ret;
+		}
+
+		// associates the value with the key, replacing any previous value. The file
+		// has to be opened for writing.
+		void add(const key_T& k, const value_T& v)
+		{
+			if (!is_open())
+				throw std::runtime_error("hash map is not open");
+			if (mFile.is_read_only())
+				throw std::runtime_error("hash map is read only");
+			u8 h = hash(k);
+			size_t i = find_index(h, k);
+			if (i == npos())
+			{
+				if (count() + 1 > max_used(capacity()))
+					rehash(capacity_for(count() + 1));
+				i = insert_index(h);
+				memcpy(mpKeys + i, &k, sizeof(key_T));
+				++header()->count;
+			}
+			memcpy(mpValues + i, &v, sizeof(value_T));
+		}
+
+		// calls proc(key, value) on each entry, in no particular order
+		template<typename Procedure>
+		void foreach(Procedure& proc) const
+		{
+			if (!is_open())
+				return;
+			for (size_t i = 0; i < capacity(); ++i)
+				if (!(mpCtrl[i] & 0x80))
+					proc(const_cast<const key_T&>(mpKeys[i]), const_cast<const value_T&>(mpValues[i]));
+		}
+
+		u8 hash(const key_T& key) const
+		{
+			static hash_T hasher;
+			return hasher(key);
+		}
+
+	private:
+
+		static size_t npos() {
+			return size_t(-1);
+		}
+
+		static size_t max_used(size_t nCapacity) {
+			return nCapacity / 8 * 7;
+		}
+
+		static size_t capacity_for(size_t n)
+		{
+			size_t ret = group::size;
+			while (max_used(ret) < n)
+				ret *= 2;
+			return ret;
+		}
+
+		static size_t align8(size_t n) {
+			return (n + 7) & ~size_t(7);
+		}
+		static size_t keys_offset(size_t nCapacity) {
+			return align8(header_size + nCapacity);
+		}
+		static size_t values_offset(size_t nCapacity) {
+			return align8(keys_offset(nCapacity) + nCapacity * sizeof(key_T));
+		}
+		static size_t file_size(size_t nCapacity) {
+			return values_offset(nCapacity) + nCapacity * sizeof(value_T);
+		}
+
+		mapped_hash_header* header() const {
+			return reinterpret_cast<mapped_hash_header*>(mFile.data());
+		}
+		size_t capacity() const {
+			return (size_t)header()->capacity;
+		}
+
+		// sets the pointers into the mapped file
+		void locate()
+		{
+			size_t n = capacity();
+			mpCtrl = mFile.data() + header_size;
+			mpKeys = reinterpret_cast<key_T*>(mFile.data() + keys_offset(n));
+			mpValues = reinterpret_cast<value_T*>(mFile.data() + values_offset(n));
+		}
+
+		// writes an empty table of n slots to the file
+		void initialize(size_t n)
+		{
+			mFile.resize(file_size(n));
+			memset(mFile.data(), 0, header_size);
+			mapped_hash_header* p = header();
+			memcpy(p->magic, "ootlhash", 8);
+			p->version = mapped_hash_version;
+			p->key_size = sizeof(key_T);
+			p->value_size = sizeof(value_T);
+			p->capacity = n;
+			p->count = 0;
+			locate();
+			memset(mpCtrl, group::empty, n);
+		}
+
+		// checks the header of an opened file
+		void validate()
+		{
+			if (mFile.size() < header_size)
+			{
+				close();
+				throw std::runtime_error("not a hash map file");
+			}
+			mapped_hash_header* p = header();
+			const char* error = NULL;
+			if (memcmp(p->magic, "ootlhash", 8) != 0)
+				error = "not a hash map file";
+			else if (p->version != mapped_hash_version)
+				error = "unsupported hash map file version";
+			else if (p->key_size != sizeof(key_T) || p->value_size != sizeof(value_T))
+				error = "hash map file has different key or value types";
+			else if (p->capacity < group::size || (p->capacity & (p->capacity - 1)) != 0
+				|| p->count > max_used((size_t)p->capacity) || mFile.size() != file_size((size_t)p->capacity))
+				error = "hash map file is corrupt";
+			if (error != NULL)
+			{
+				close();
+				throw std::runtime_error(error);
+			}
+			locate();
+		}
+
+		// the low 7 bits of the hash code are stored in the control byte, the
+		// remaining bits choose the first group
+		static u1 tag(u8 hash_code) {
+			return (u1)(hash_code & 0x7F);
+		}
+
+		size_t first_group(u8 hash_code) const {
+			return (size_t)(hash_code >> 7) & (capacity() / group::size - 1);
+		}
+
+		size_t find_index(u8 hash_code, const key_T& key) const
+		{
+			size_t nMask = capacity() / group::size - 1;
+			size_t g = first_group(hash_code);
+			u1 t = tag(hash_code);
+			for (size_t nStep = 1; ; ++nStep)
+			{
+				group grp(mpCtrl + g * group::size);
+				u4 m = grp.match(t);
+				while (m != 0)
+				{
+					size_t i = g * group::size + group::first(m);
+					if (memcmp(mpKeys + i, &key, sizeof(key_T)) == 0)
+						return i;
+					m &= m - 1;
+				}
+				if (grp.match_empty() != 0)
+					return npos();
+				g = (g + nStep) & nMask;
+			}
+		}
+
+		// marks the first empty slot in the probe sequence as used, and returns its index
+		size_t insert_index(u8 hash_code)
+		{
+			size_t nMask = capacity() / group::size - 1;
+			size_t g = first_group(hash_code);
+			for (size_t nStep = 1; ; ++nStep)
+			{
+				u4 m = group(mpCtrl + g * group::size).match_empty();
+				if (m != 0)
+				{
+					size_t i = g * group::size + group::first(m);
+					mpCtrl[i] = tag(hash_code);
+					return i;
+				}
+				g = (g + nStep) & nMask;
+			}
+		}
+
+		// The entries are added to a new table in a temporary file, which is written to 
+		// disk before it replaces the map file. Until then the map file is untouched.
+		void rehash(size_t nCapacity)
+		{
+			string tmpPath = mPath + ".tmp";
+			try
+			{
+				self tmp;
+				tmp.mFile.open(tmpPath.c_str(), false, true);
+				tmp.initialize(nCapacity);
+				for (size_t i = 0; i < capacity(); ++i)
+				{
+					if (mpCtrl[i] & 0x80)
+						continue;
+					size_t j = tmp.insert_index(hash(mpKeys[i]));
+					memcpy(tmp.mpKeys + j, mpKeys + i, sizeof(key_T));
+					memcpy(tmp.mpValues + j, mpValues + i, sizeof(value_T));
+				}
+				tmp.header()->count = header()->count;
+				tmp.sync();
+			}
+			catch (...)
+			{
+				::remove(tmpPath.c_str());
+				throw;
+			}
+			// the map file has to be closed before it can be replaced on Windows
+			string path = mPath;
+			close();
+			try
+			{
+				mapped_file::replace(tmpPath.c_str(), path.c_str());
+			}
+			catch (...)
+			{
+				::remove(tmpPath.c_str());
+				open(path.c_str());
+				throw;
+			}
+			open(path.c_str());
+		}
+
+		// hide the copy constructor and assignment operator
+		mapped_hash_map(const self&);
+		void operator=(const self&);
+
+		mapped_file mFile;
+		string mPath;
+		u1* mpCtrl;
+		key_T* mpKeys;
+		value_T* mpValues;
+	};
+}
+
+#endif
@@ -8,21 +8,75 @@
 #include <memory>
 
 #include "ootl_string.hpp"
+#include "ootl_symbol.hpp"
+#include "ootl_pool.hpp"
+
+#ifdef OOTL_HAS_MOVE
+#include <type_traits>
+#endif
 
 namespace ootl
 {  
 	typedef const std::type_info& TI;
+
+	// Each type held by an object can be given a small integer tag, so that object::is<T>()
+	// is an integer comparison. Types without a tag are identified by comparing type_info
+	// objects instead. Tags below object_first_user_tag are used by ootl, other libraries
+	// give their types tags using OOTL_OBJECT_TYPE_TAG (at global scope).
+	const unsigned int object_untagged_type = 0xFFFFFFFF;
+	const unsigned int object_first_user_tag = 32;
+
+	template<typename T>
+	struct object_type_tag {
+		static const unsigned int value = object_untagged_type;
+	};
+
+#define OOTL_OBJECT_TYPE_TAG(T, N) \
+	namespace ootl { \
+		template<> struct object_type_tag<T> { static const unsigned int value = N; }; \
+	}
+
+	// used to identify empty object types 
+	struct object_empty {
+		bool operator==(const object_empty& x) const { return true; } 
+	};
+
+#define OOTL_BUILTIN_TYPE_TAG(T, N) \
+	template<> struct object_type_tag<T> { static const unsigned int value = N; };
+
+	OOTL_BUILTIN_TYPE_TAG(object_empty, 0)
+	OOTL_BUILTIN_TYPE_TAG(bool, 1)
+	OOTL_BUILTIN_TYPE_TAG(char, 2)
+	OOTL_BUILTIN_TYPE_TAG(int, 3)
+	OOTL_BUILTIN_TYPE_TAG(unsigned int, 4)
+	OOTL_BUILTIN_TYPE_TAG(long, 5)
+	OOTL_BUILTIN_TYPE_TAG(unsigned long, 6)
+	OOTL_BUILTIN_TYPE_TAG(long long, 7)
+	OOTL_BUILTIN_TYPE_TAG(unsigned long long, 8)
+	OOTL_BUILTIN_TYPE_TAG(float, 9)
+	OOTL_BUILTIN_TYPE_TAG(double, 10)
+	OOTL_BUILTIN_TYPE_TAG(symbol, 11)
+
+#undef OOTL_BUILTIN_TYPE_TAG
 	  
+	// the number of bytes of a value that an object can hold without allocating memory
+#ifndef OOTL_OBJECT_BUFFER_SIZE
+#define OOTL_OBJECT_BUFFER_SIZE sizeof(void*)
+#endif
+
+	// values that do not fit in the buffer, and are no bigger than this, are allocated from a
+	// per-type thread local pool_allocator instead of with new. Define it as 0 to always use new.
+#ifndef OOTL_OBJECT_POOL_MAX_SIZE
+#define OOTL_OBJECT_POOL_MAX_SIZE 256
+#endif
+
 	// can hold a copy of any copy constructible class
 	struct object 
 	{   
 		// this represents the maximum size of an Object for its copy / etc. to be optimized 
-		static const int buffer_size = sizeof(void*); 
+		static const int buffer_size = OOTL_OBJECT_BUFFER_SIZE; 
 	  
-		// used to identify empty object types 
-		struct empty {
-			bool operator==(const empty& x) const { return true; } 
-		};
+		typedef object_empty empty;
 
 		// used to hold an Object or a pointer to an Object
 		union holder {
@@ -36,6 +90,7 @@ namespace ootl
 		
 		// function pointer table
 		struct fxn_ptr_table {
+			unsigned int tag;
 			TI (*type_info)();
 			void* (*get_ptr)(holder&);
 			const void* (*get_const_ptr)(const holder&);
@@ -72,28 +127,62 @@ namespace ootl
 			static void* get_ptr(holder& x) { return x.pointer; } 
 			static const void* get_const_ptr(const holder& x) { return x.pointer; } 
 			static void  destructor(holder& x) { cast(x)->~T(); }
-			static void  deleter(holder& x) { delete(cast(x)); }
+			static void  deleter(holder& x) { destructor(x); deallocate(x.pointer); }
 			static bool  equals(const holder& x, const holder& y) { return *cast(x) == *cast(y); }
-			static void  clone(holder& x, const holder& y) { x.pointer = new T(*cast(y)); }
+			static void  clone(holder& x, const holder& y) { x.pointer = create(*cast(y)); }
+
+			static const bool pooled = sizeof(T) <= OOTL_OBJECT_POOL_MAX_SIZE;
+			static void* allocate() { 
+				return pooled ? pool_allocator<T>::allocate() : ::operator new(sizeof(T)); 
+			}
+			static void deallocate(void* p) { 
+				if (pooled) pool_allocator<T>::deallocate(p); else ::operator delete(p); 
+			}
+			static void* create(const T& x) {
+				void* p = allocate();
+				try { return new(p) T(x); }
+				catch (...) { deallocate(p); throw; }
+			}
+#ifdef OOTL_HAS_MOVE
+			static void* create_move(T& x) {
+				void* p = allocate();
+				try { return new(p) T(std::move(x)); }
+				catch (...) { deallocate(p); throw; }
+			}
+#endif
 		};  
 		
-		// this creates a function pointer table which points to functions for dealing with
-		// either optimized or unoptimized types. 	
+		// true if T is stored in holder::buffer. Objects are moved with memcpy, 
+		// so only relocatable types can be stored there.
+		template<typename T>
+		struct can_optimize {
+			static const bool value = sizeof(T) <= buffer_size 
+				&& OOTL_ALIGNOF(T) <= OOTL_ALIGNOF(holder)
+				&& is_relocatable<T>::value;
+		};
+
+		// a function pointer table which points to functions for dealing with either 
+		// optimized or unoptimized types. It is defined below the object class.
+		template<typename T>
+		struct table_of {
+			static const fxn_ptr_table value;
+		};
+
 		template<typename T> 
-		static fxn_ptr_table* get_table() {
-		  const bool optimize = sizeof(T) <= buffer_size;
-			static fxn_ptr_table static_table = {
-				&fxns<T, optimize>::type_info
-			  , &fxns<T, optimize>::get_ptr
-			  , &fxns<T, optimize>::get_const_ptr
-			  , &fxns<T, optimize>::destructor
-			  , &fxns<T, optimize>::deleter
-			  , &fxns<T, optimize>::equals
-			  , &fxns<T, optimize>::clone
-			};
-			return &static_table;
+		static const fxn_ptr_table* get_table() {
+			return &table_of<T>::value;
 		}	
 
+		// the pool statistics of the calling thread for values of type T, 
+		// which are all zero if T is not allocated from a pool
+		template<typename T>
+		static pool_stats get_pool_stats() {
+			pool_stats ret = { 0, 0, 0 };
+			if (!can_optimize<T>::value && fxns<T, false>::pooled)
+				ret = pool_allocator<T>::stats();
+			return ret;
+		}
+
 		struct bad_object_cast {
 		  bad_object_cast(TI x, TI y) :
 			from(x), to(y)
@@ -105,49 +194,93 @@ namespace ootl
 	  
 		// constructors   
 		object() {
-			table = get_table<empty>();
+			set_table(get_table<empty>());
 			held.pointer = NULL;
 		}
 		object(const object& x) {
-			table = get_table<empty>();
+			set_table(get_table<empty>());
 			held.pointer = NULL;
 			assign(x);
 		}  
 		template <typename T>
 		object(const T& x) {
-			table = get_table<empty>();
+			set_table(get_table<empty>());
 			held.pointer = NULL;
 			initialize(x);
 		}    
+		// strings are held as interned symbols
 		object(const char* x) {
-			table = get_table<empty>();
+			set_table(get_table<empty>());
 			held.pointer = NULL;
-			initialize(cstring(x));
+			initialize(symbol(x));
 		}    
+#ifdef OOTL_HAS_MOVE
+		// takes the value of x, leaving it empty. Like move_to() this copies the 
+		// holder: a value in the buffer is relocatable and a pointer is stolen.
+		object(object&& x) {
+			set_table(x.table);
+			held = x.held;
+			x.release_nodestroy();
+		}
+		// moves a temporary value into the object, instead of copying it
+		template <typename T>
+		object(T&& x, typename std::enable_if<!std::is_reference<T>::value 
+			&& !std::is_same<typename std::decay<T>::type, object>::value
+			&& !std::is_convertible<T, const char*>::value>::type* = NULL) 
+		{
+			set_table(get_table<empty>());
+			held.pointer = NULL;
+			initialize_move(x);
+		}
+#endif
+
 		~object() {
 			release();
 		}    
 		// assignment
 		template<typename T>
 		void initialize(const T& x) {
-			table = get_table<T>();
-			if (sizeof(T) <= buffer_size) 
+			set_table(get_table<T>());
+			if (can_optimize<T>::value) 
 				new(held.buffer) T(x);
 			else 
-				held.pointer = new T(x); 
+				held.pointer = fxns<T, false>::create(x); 
 		}
+#ifdef OOTL_HAS_MOVE
+		template<typename T>
+		void initialize_move(T& x) {
+			set_table(get_table<T>());
+			if (can_optimize<T>::value) 
+				new(held.buffer) T(std::move(x));
+			else 
+				held.pointer = fxns<T, false>::create_move(x); 
+		}
+		object& operator=(object&& x) {
+			if (this != &x) {
+				release();
+				set_table(x.table);
+				held = x.held;
+				x.release_nodestroy();
+			}
+			return *this;
+		}
+#endif
 		object& assign(const object& x) {
 			release();
-			table = x.table;	  
+			set_table(x.table);	  
 			table->clone(held, x.held);
 			return *this;
 		}
 		template<typename T>
 		object& operator=(const T& x) {
+#ifdef OOTL_HAS_MOVE
+			return *this = object(x);
+#else
 			return assign(object(x));
+#endif
 		}
 		object& operator=(const char* x) {
-			return assign(object(cstring(x)));
+			return assign(object(symbol(x)));
 		}
 		object& operator=(const object& x) {
 			return assign(x);
@@ -156,8 +289,11 @@ namespace ootl
 		TI type_info() const {
 			return table->type_info();
 		}
+		// a single integer comparison if T has a tag 
 		template<typename T>
 		bool is() const {
+			if (object_type_tag<T>::value != object_untagged_type)
+				return tag == object_type_tag<T>::value;
 			return type_info() == typeid(T) ? true : false;
 		}
 		template<typename T>
@@ -181,20 +317,24 @@ namespace ootl
 			return reinterpret_cast<const T*>(table->get_const_ptr(held));
 		}
 		bool is_empty() const {
-			return table == get_table<empty>();
+			return tag == object_type_tag<empty>::value;
 		}
 		void move_to(object& o) {
 			memcpy(&o, this, sizeof(*this));
-			table = get_table<empty>();
+			set_table(get_table<empty>());
 		}
 		void release() {
 			if (is_empty()) return; 
 			table->deleter(held);
-			table = get_table<empty>();
+			set_table(get_table<empty>());
 		}
 		void release_nodestroy() {
-			table = get_table<empty>();
+			set_table(get_table<empty>());
 		}		
+		void set_table(const fxn_ptr_table* x) {
+			table = x;
+			tag = x->tag;
+		}
 		object* operator->() {
 			return this;
 		}
@@ -203,9 +343,31 @@ namespace ootl
 		}
 		
 		// fields 
-		fxn_ptr_table* table;
+		const fxn_ptr_table* table;
+		// a copy of table->tag
+		unsigned int tag;
 		holder held;
 	};
+
+	// an object only holds relocatable values or pointers
+	template<>
+	struct is_relocatable<object> {
+		static const bool value = true;
+	};
+
+	// the tables are constant-initialized, so unlike a function-local static they are
+	// used without a guard
+	template<typename T>
+	const object::fxn_ptr_table object::table_of<T>::value = {
+		object_type_tag<T>::value
+	  , &object::fxns<T, object::can_optimize<T>::value>::type_info
+	  , &object::fxns<T, object::can_optimize<T>::value>::get_ptr
+	  , &object::fxns<T, object::can_optimize<T>::value>::get_const_ptr
+	  , &object::fxns<T, object::can_optimize<T>::value>::destructor
+	  , &object::fxns<T, object::can_optimize<T>::value>::deleter
+	  , &object::fxns<T, object::can_optimize<T>::value>::equals
+	  , &object::fxns<T, object::can_optimize<T>::value>::clone
+	};
 }
 
 #endif
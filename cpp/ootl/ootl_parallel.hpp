@@ -0,0 +1,258 @@
+// Public Domain by Christopher Diggins
+// http://www.ootl.org
+//
+// Parallel algorithms over stacks. The buffers of a vlist never move and their sizes are
+// known, so they are natural units of work: each buffer (or a sub-range of one of the larger
+// buffers) is handed to a thread in a pool. Requires C++11 threads.
+
+#ifndef OOTL_PARALLEL_HPP
+#define OOTL_PARALLEL_HPP
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
+
+#include "ootl_stack.hpp"
+
+namespace ootl
+{
+	/////////////////////////////////////////////////////////
+	// thread_pool
+
+	struct thread_pool
+	{
+		// the calling thread also does work, so n - 1 threads are created
+		thread_pool(size_t n = std::thread::hardware_concurrency())
+			: mpJob(NULL), mnGeneration(0), mbStop(false)
+		{
+			for (size_t i = 1; i < n; ++i)
+				mThreads.push(new std::thread(&thread_pool::worker, this));
+		}
+
+		~thread_pool()
+		{
+			{
+				std::lock_guard<std::mutex> lock(mMutex);
+				mbStop = true;
+			}
+			mWake.notify_all();
+			while (!mThreads.is_empty())
+			{
+				std::thread* p = mThreads.pull();
+				p->join();
+				delete p;
+			}
+		}
+
+		size_t size() const
+		{
+			return mThreads.count() + 1;
+		}
+
+		// calls f(i) for each i in [0, n) and returns once all calls are complete.
+		// The first exception thrown by f is rethrown here. This must not be
+		// called from inside of a task running in the same pool.
+		template<typename F>
+		void run(size_t n, F& f)
+		{
+			std::lock_guard<std::mutex> run_lock(mRunMutex);
+			job j(n, &call<F>, &f);
+			{
+				std::lock_guard<std::mutex> lock(mMutex);
+				mpJob = &j;
+				++mnGeneration;
+			}
+			mWake.notify_all();
+			work(j);
+			std::unique_lock<std::mutex> lock(mMutex);
+			mpJob = NULL;
+			mDone.wait(lock, [&j] { return j.nDone == j.n && j.nWorkers == 0; });
+			if (j.error)
+				std::rethrow_exception(j.error);
+		}
+
+	private:
+
+		struct job
+		{
+			job(size_t count, void (*fxn)(void*, size_t), void* data)
+				: n(count), nNext(0), nDone(0), nWorkers(0), f(fxn), pData(data)
+			{ }
+			size_t n;
+			std::atomic<size_t> nNext;
+			std::atomic<size_t> nDone;
+			size_t nWorkers;
+			void (*f)(void*, size_t);
+			void* pData;
+			std::exception_ptr error;
+		};
+
+		template<typename F>
+		static void call(void* p, size_t i)
+		{
+			(*static_cast<F*>(p))(i);
+		}
+
+		void work(job& j)
+		{
+			size_t i;
+			while ((i = j.nNext++) < j.n)
+			{
+				try
+				{
+					j.f(j.pData, i);
+				}
+				catch (...)
+				{
+					std::lock_guard<std::mutex> lock(mMutex);
+					if (!j.error)
+						j.error = std::current_exception();
+				}
+				if (++j.nDone == j.n)
+				{
+					std::lock_guard<std::mutex> lock(mMutex);
+					mDone.notify_all();
+				}
+			}
+		}
+
+		void worker()
+		{
+			size_t nSeen = 0;
+			std::unique_lock<std::mutex> lock(mMutex);
+			while (true)
+			{
+				mWake.wait(lock, [this, nSeen] { return mbStop || mnGeneration != nSeen; });
+				if (mbStop)
+					return;
+				nSeen = mnGeneration;
+				job* j = mpJob;
+				if (j == NULL)
+					continue;
+				++j->nWorkers;
+				lock.unlock();
+				work(*j);
+				lock.lock();
+				if (--j->nWorkers == 0)
+					mDone.notify_all();
+			}
+		}
+
+		// hide the copy constructor and assignment operator
+		thread_pool(const thread_pool&);
+		void operator=(const thread_pool&);
+
+		stack<std::thread*> mThreads;
+		std::mutex mRunMutex;
+		std::mutex mMutex;
+		std::condition_variable mWake;
+		std::condition_variable mDone;
+		job* mpJob;
+		size_t mnGeneration;
+		bool mbStop;
+	};
+
+	// a pool with one thread per hardware thread, created on first use
+	inline thread_pool& default_thread_pool()
+	{
+		static thread_pool pool;
+		return pool;
+	}
+
+	/////////////////////////////////////////////////////////
+	// work partitioning
+
+	// the default maximum number of items handed to a single task
+	const size_t default_parallel_grain = 16384;
+
+	// a contiguous run of items, index is counted from the bottom of the stack
+	template<typename T>
+	struct segment_chunk
+	{
+		T* begin;
+		size_t count;
+		size_t index;
+	};
+
+	// splits a stack (or any container providing get_segment) into chunks
+	// of at most grain items, from the bottom to the top
+	template<typename Stack_T, typename T>
+	void split_into_chunks(Stack_T& s, size_t grain, stack<segment_chunk<T> >& chunks)
+	{
+		ootl_assert(grain > 0);
+		size_t n = 0;
+		while (n < s.count())
+		{
+			T* begin;
+			T* end;
+			T* p = s.get_segment(n, begin, end);
+			while (p != end)
+			{
+				segment_chunk<T> c;
+				c.begin = p;
+				c.count = (size_t)(end - p) < grain ? end - p : grain;
+				c.index = n;
+				chunks.push(c);
+				p += c.count;
+				n += c.count;
+			}
+		}
+	}
+
+	/////////////////////////////////////////////////////////
+	// parallel algorithms
+
+	// calls proc on every item of the stack. The calls are made concurrently
+	// so proc must be safe to call from multiple threads.
+	template<typename Stack_T, typename Procedure_T>
+	void parallel_foreach(Stack_T& s, Procedure_T& proc, size_t grain = default_parallel_grain,
+		thread_pool& pool = default_thread_pool())
+	{
+		typedef typename Stack_T::value_type T;
+		stack<segment_chunk<T> > chunks;
+		split_into_chunks(s, grain, chunks);
+		typename stack<segment_chunk<T> >::iterator first = chunks.begin();
+		auto task = [&](size_t i) {
+			const segment_chunk<T>& c = first[i];
+			T* p = c.begin;
+			T* end = p + c.count;
+			while (p != end)
+				proc(*p++);
+		};
+		pool.run(chunks.count(), task);
+	}
+
+	// combines the items of the stack from bottom to top, and returns
+	// init op x0 op x1 ... op xn. Each chunk is reduced separately and the
+	// partial results are combined in order, so op needs to be associative
+	// but not commutative. The result doesn't depend on thread scheduling.
+	template<typename Stack_T, typename Value_T, typename Op_T>
+	Value_T parallel_reduce(const Stack_T& s, Value_T init, Op_T op, size_t grain = default_parallel_grain,
+		thread_pool& pool = default_thread_pool())
+	{
+		typedef const typename Stack_T::value_type T;
+		stack<segment_chunk<T> > chunks;
+		split_into_chunks(s, grain, chunks);
+		stack<Value_T> partials(chunks.count(), init);
+		typename stack<segment_chunk<T> >::iterator first = chunks.begin();
+		typename stack<Value_T>::iterator results = partials.begin();
+		auto task = [&](size_t i) {
+			const segment_chunk<T>& c = first[i];
+			T* p = c.begin;
+			T* end = p + c.count;
+			Value_T acc = *p++;
+			while (p != end)
+				acc = op(acc, *p++);
+			results[i] = acc;
+		};
+		pool.run(chunks.count(), task);
+		typename stack<Value_T>::iterator i = partials.begin();
+		for (; i != partials.end(); ++i)
+			init = op(init, *i);
+		return init;
+	}
+}
+
+#endif
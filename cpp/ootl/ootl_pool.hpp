@@ -0,0 +1,125 @@
+// Public Domain by Christopher Diggins
+// http://www.ootl.org
+//
+// A pool_allocator<T> hands out blocks for single objects of type T. Blocks are carved out
+// of larger slabs, and freed blocks are kept in a thread local free list, so allocating and
+// freeing is a few instructions and never locks. A block can be freed by another thread than
+// the one that allocated it, it then joins the free list of that thread.
+// Note: slabs are never released, not even when a thread exits.
+
+#ifndef OOTL_POOL_HPP
+#define OOTL_POOL_HPP
+
+#include "ootl_vlist.hpp"
+
+namespace ootl
+{
+	// the slabs of a pool, as seen by one thread
+	struct pool_stats
+	{
+		// the number of slabs allocated by the thread
+		size_t slabs;
+		// the number of blocks in those slabs
+		size_t capacity;
+		// the number of blocks allocated by the thread, less the ones it freed
+		long in_use;
+
+		double occupancy() const
+		{
+			return capacity == 0 ? 0.0 : (double)in_use / capacity;
+		}
+	};
+
+	template<typename T>
+	struct pool_allocator
+	{
+		// the size of a slab, unless a block is bigger than this
+		static const size_t slab_bytes = 4096;
+
+		// blocks are aligned to at least this even on 32 bit platforms, so that the 
+		// low 3 bits of a pointer to a block can be used as a tag
+		static const size_t min_alignment = 8;
+
+		// the alignment of blocks, a power of two
+		static size_t alignment()
+		{
+			size_t ret = OOTL_ALIGNOF(T) > sizeof(void*) ? OOTL_ALIGNOF(T) : sizeof(void*);
+			return ret > min_alignment ? ret : min_alignment;
+		}
+
+		// blocks are big enough for T and for the free list link, and keep T aligned
+		static size_t block_size()
+		{
+			size_t nAlign = alignment();
+			return (sizeof(T) + nAlign - 1) / nAlign * nAlign;
+		}
+
+		static size_t blocks_per_slab()
+		{
+			size_t n = slab_bytes / block_size();
+			return n == 0 ? 1 : n;
+		}
+
+		static void* allocate()
+		{
+			state& s = get_state();
+			if (s.free_list == NULL)
+				add_slab(s);
+			void* ret = s.free_list;
+			s.free_list = *(void**)ret;
+			++s.stats.in_use;
+			return ret;
+		}
+
+		static void deallocate(void* p)
+		{
+			state& s = get_state();
+			*(void**)p = s.free_list;
+			s.free_list = p;
+			--s.stats.in_use;
+		}
+
+		// the statistics of the calling thread
+		static pool_stats stats()
+		{
+			return get_state().stats;
+		}
+
+	private:
+
+		struct state
+		{
+			void* free_list;
+			pool_stats stats;
+		};
+
+		static state& get_state()
+		{
+			static OOTL_THREAD_LOCAL state s;
+			return s;
+		}
+
+		// links the blocks of a new slab into the free list, the start of the slab is 
+		// rounded up to the alignment of the blocks
+		static void add_slab(state& s)
+		{
+			size_t nBlock = block_size();
+			size_t n = blocks_per_slab();
+			size_t nAlign = alignment();
+			char* p = static_cast<char*>(malloc(nBlock * n + nAlign - 1));
+			if (p == NULL)
+				throw std::bad_alloc();
+			p += (nAlign - (size_t)p % nAlign) % nAlign;
+			for (size_t i = 0; i < n; ++i)
+			{
+				void* tmp = p + (n - i - 1) * nBlock;
+				*(void**)tmp = s.free_list;
+				s.free_list = tmp;
+			}
+			++s.stats.slabs;
+			s.stats.capacity += n;
+		}
+	};
+}
+
+#endif
@@ -0,0 +1,425 @@
+// Public Domain by Christopher Diggins
+// http://www.ootl.org
+//
+// A small_stack stores its first N items inside of itself, and only creates an ootl::stack
+// for the remaining items once it overflows. Most stacks used as values (e.g. lists in Cat)
+// are empty or very small, so this avoids any heap allocation in the common case. The interface
+// is the same as ootl::stack.
+
+#ifndef OOTL_SMALL_STACK_HPP
+#define OOTL_SMALL_STACK_HPP
+
+#include "ootl_stack.hpp"
+
+namespace ootl
+{
+	template < typename T, size_t N, typename Policy_T = default_vlist_policy, typename Alloc_T = malloc_vlist_allocator >
+	struct small_stack
+	{
+	public:
+
+		//////////////////////////////////////////////////////
+		// public type defs
+
+		typedef small_stack self;
+		typedef T value_type;
+		typedef stack<T, Policy_T, Alloc_T> spill_type;
+		typedef segmented_iterator<self, T*> iterator;
+		typedef segmented_iterator<const self, const T*> const_iterator;
+		typedef std::reverse_iterator<iterator> reverse_iterator;
+		typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+
+		//////////////////////////////////////////////////////
+		// constructor/destructors
+
+		small_stack() : cnt(0), mpSpill(NULL) {
+		}
+		small_stack(const self& x) : cnt(0), mpSpill(NULL) {
+			reserve(x.cnt);
+			append(x);
+		}
+		// constructs a stack from an array, the last item ends up on top
+		small_stack(const T* first, const T* last) : cnt(0), mpSpill(NULL) {
+			reserve(last - first);
+			append(first, last - first);
+		}
+#ifdef OOTL_HAS_MOVE
+		// takes the items of x, leaving it empty
+		small_stack(self&& x) : cnt(0), mpSpill(NULL) {
+			swap(x);
+		}
+#endif
+		// the spill stack destroys its own items
+		~small_stack() {
+			destroy_inline();
+			delete mpSpill;
+		}
+
+		//////////////////////////////////////////////////////
+		// implementation of OOTL Indexable concept
+		//
+		// Note: ootl::small_stack[0] is the top of the stack.
+
+		const T& get_at(size_t n) {
+			return operator[](n);
+		}
+		void set_at(size_t n, const T& x) {
+			operator[](n) = x;
+		}
+		T& operator[](size_t n) {
+			ootl_assert(n < cnt);
+			size_t i = cnt - n - 1;
+			if (i < N)
+				return get_inline()[i];
+			return (*mpSpill)[n];
+		}
+		const T& operator[](size_t n) const {
+			return const_cast<self*>(this)->operator[](n);
+		}
+		size_t count() const {
+			return cnt;
+		}
+
+		///////////////////////////////////////////////////
+		// implementation of OOTL Stack concept
+
+		void push(const T& x) {
+			push_nocreate();
+			new(&top()) T(x);
+		}
+		void push() {
+			push_nocreate();
+			new(&top()) T();
+		}
+#ifdef OOTL_HAS_MOVE
+		void push(T&& x) {
+			push_nocreate();
+			new(&top()) T(std::move(x));
+		}
+		// constructs an item on top of the stack from the arguments
+		template<typename... Args_T>
+		void emplace(Args_T&&... args) {
+			push_nocreate();
+			new(&top()) T(std::forward<Args_T>(args)...);
+		}
+#endif
+		// adds space for an object, without constructing
+		void push_nocreate() {
+			// the spill stack is kept once created
+			if (cnt >= N)
+				get_spill()->push_nocreate();
+			++cnt;
+		}
+		void pop() {
+			top().~T();
+			pop_nodestroy();
+		}
+		// removes an object without calling destructor
+		void pop_nodestroy() {
+			ootl_assert(cnt > 0);
+			if (cnt > N)
+				mpSpill->pop_nodestroy();
+			--cnt;
+		}
+		bool is_empty() {
+			return count() == 0;
+		}
+		T& top() {
+			ootl_assert(cnt > 0);
+			if (cnt > N)
+				return mpSpill->top();
+			return get_inline()[cnt - 1];
+		}
+		const T& top() const {
+			return const_cast<self*>(this)->top();
+		}
+		T pull() {
+			ootl_assert(cnt > 0);
+#ifdef OOTL_HAS_MOVE
+			T ret(std::move(top()));
+#else
+			T ret = top();
+#endif
+			pop();
+			return ret;
+		}
+		void clear() {
+			destroy_inline();
+			if (mpSpill != NULL)
+				mpSpill->clear();
+			cnt = 0;
+		}
+		void clear_nodestroy() {
+			if (mpSpill != NULL)
+				mpSpill->clear_nodestroy();
+			cnt = 0;
+		}
+		// like clear, but only the first buffer of the spill stack is kept
+		void reset() {
+			clear();
+			if (mpSpill != NULL)
+				mpSpill->reset();
+		}
+
+		///////////////////////////////////////////////////
+		// bulk operations, the inline items are handled as one block and 
+		// the rest is forwarded to the spill stack
+
+		// pushes n copies of x
+		void push_n(size_t n, const T& x) {
+			size_t k = inline_room(n);
+			std::uninitialized_fill_n(get_inline() + cnt, k, x);
+			cnt += k;
+			n -= k;
+			if (n > 0) {
+				get_spill()->push_n(n, x);
+				cnt += n;
+			}
+		}
+		// pops n items
+		void pop_n(size_t n) {
+			ootl_assert(n <= cnt);
+			if (cnt > N) {
+				size_t k = cnt - N < n ? cnt - N : n;
+				mpSpill->pop_n(k);
+				cnt -= k;
+				n -= k;
+			}
+			destroy(get_inline() + cnt - n, n);
+			cnt -= n;
+		}
+		// pushes n items from an array, the last item ends up on top
+		void append(const T* p, size_t n) {
+			size_t k = inline_room(n);
+			copy_construct(get_inline() + cnt, p, k);
+			cnt += k;
+			if (n > k) {
+				get_spill()->append(p + k, n - k);
+				cnt += n - k;
+			}
+		}
+		// pushes the items of x, from the bottom of x to the top
+		void append(const self& x) {
+			ootl_assert(&x != this);
+			append(const_cast<self&>(x).get_inline(), x.cnt < N ? x.cnt : N);
+			if (x.cnt > N) {
+				get_spill()->append(*x.mpSpill);
+				cnt += x.cnt - N;
+			}
+		}
+		// allocates the buffers needed to hold n items
+		void reserve(size_t n) {
+			if (n > N)
+				get_spill()->reserve(n - N);
+		}
+		// moves all items of x on to the top of this stack, leaving x empty. 
+		// The inline items of x are relocated, and its spill stack is spliced 
+		// on to this one's, so its buffers are taken if this one is empty.
+		void splice(self& x) {
+			ootl_assert(&x != this);
+			if (is_empty()) {
+				swap(x);
+				return;
+			}
+			size_t n = x.cnt < N ? x.cnt : N;
+			size_t k = inline_room(n);
+			relocate(get_inline() + cnt, x.get_inline(), k);
+			cnt += k;
+			if (n > k) {
+				spill_type* p = get_spill();
+				for (size_t i = k; i < n; ++i) {
+					p->push_nocreate();
+					relocate(&p->top(), x.get_inline() + i, 1);
+				}
+				cnt += n - k;
+			}
+			if (x.cnt > N) {
+				get_spill()->splice(*x.mpSpill);
+				cnt += x.cnt - N;
+			}
+			x.cnt = 0;
+		}
+
+		//////////////////////////////////////////////////////
+		// implementation of OOTL Growable, Shrinkable and Resizable concepts
+
+		void grow(size_t n = 1, const value_type& x = value_type()) {
+			push_n(n, x);
+		}
+		void shrink(size_t n = 1) {
+			pop_n(n);
+		}
+		void resize(size_t n, const value_type& x = value_type()) {
+			if (n > count())
+				push_n(n - count(), x);
+			else
+				pop_n(count() - n);
+		}
+
+		//////////////////////////////////////////////////////
+		// implementation of OOTL Iterable concept
+
+		template<typename Procedure>
+		void foreach(Procedure& proc) const {
+			T* p = const_cast<self*>(this)->get_inline();
+			T* end = p + (cnt < N ? cnt : N);
+			while (p != end)
+				proc(*p++);
+			if (cnt > N)
+				mpSpill->foreach(proc);
+		}
+
+		//////////////////////////////////////////////////////
+		// iterators
+
+		iterator begin() { return iterator(this, 0); }
+		iterator end() { return iterator(this, count()); }
+		const_iterator begin() const { return const_iterator(this, 0); }
+		const_iterator end() const { return const_iterator(this, count()); }
+		reverse_iterator rbegin() { return reverse_iterator(end()); }
+		reverse_iterator rend() { return reverse_iterator(begin()); }
+		const_reverse_iterator rbegin() const { return const_reverse_iterator(end()); }
+		const_reverse_iterator rend() const { return const_reverse_iterator(begin()); }
+
+		// the inline items form the first segment, see ootl::segmented_iterator
+		T* get_segment(size_t n, T*& begin, T*& end) const {
+			ootl_assert(n < cnt);
+			if (n >= N)
+				return mpSpill->get_segment(n - N, begin, end);
+			begin = const_cast<self*>(this)->get_inline();
+			end = begin + (cnt < N ? cnt : N);
+			return begin + n;
+		}
+		const T* get_segment(size_t n, const T*& begin, const T*& end) const {
+			T* b;
+			T* e;
+			T* ret = get_segment(n, b, e);
+			begin = b;
+			end = e;
+			return ret;
+		}
+
+		//////////////////////////////////////////////////////
+		// Utility functions
+
+		// exchanges the contents of two small stacks. The spill stacks are exchanged 
+		// by pointer, but the inline items have to be swapped one at a time.
+		void swap(self& x) {
+			size_t n1 = cnt < N ? cnt : N;
+			size_t n2 = x.cnt < N ? x.cnt : N;
+			size_t m = n1 < n2 ? n1 : n2;
+			T* p1 = get_inline();
+			T* p2 = x.get_inline();
+			for (size_t i = 0; i < m; ++i)
+				std::swap(p1[i], p2[i]);
+			if (n1 > n2)
+				relocate(p2 + m, p1 + m, n1 - m);
+			else
+				relocate(p1 + m, p2 + m, n2 - m);
+			std::swap(cnt, x.cnt);
+			std::swap(mpSpill, x.mpSpill);
+		}
+
+		// copies the items from the bottom of the stack to the top
+		void copy_to_array(T* arr) const
+		{
+			size_t n = cnt < N ? cnt : N;
+			copy_array(arr, const_cast<self*>(this)->get_inline(), n);
+			if (cnt > N)
+				mpSpill->copy_to_array(arr + n);
+		}
+
+		bool operator==(const self& x) const
+		{
+			if (count() != x.count())
+				return false;
+			T* p = const_cast<self*>(this)->get_inline();
+			if (!std::equal(p, p + (cnt < N ? cnt : N), const_cast<self&>(x).get_inline()))
+				return false;
+			return cnt <= N || *mpSpill == *x.mpSpill;
+		}
+
+	private:
+
+		T* get_inline() {
+			return reinterpret_cast<T*>(mInline.buffer);
+		}
+
+		// the number of the next n items that fit in the inline storage
+		size_t inline_room(size_t n) const {
+			size_t k = cnt < N ? N - cnt : 0;
+			return k < n ? k : n;
+		}
+
+		spill_type* get_spill() {
+			if (mpSpill == NULL)
+				mpSpill = new spill_type();
+			return mpSpill;
+		}
+
+		static void copy_construct(T* dest, const T* src, size_t n) {
+			if (is_trivially_copyable<T>::value)
+				memcpy(dest, src, n * sizeof(T));
+			else
+				std::uninitialized_copy(src, src + n, dest);
+		}
+
+		static void copy_array(T* dest, const T* src, size_t n) {
+			if (is_trivially_copyable<T>::value)
+				memcpy(dest, src, n * sizeof(T));
+			else
+				std::copy(src, src + n, dest);
+		}
+
+		static void destroy(T* p, size_t n) {
+			if (!is_trivially_destructible<T>::value)
+				while (n--)
+					(p++)->~T();
+		}
+
+		void destroy_inline() {
+			if (is_trivially_destructible<T>::value)
+				return;
+			T* p = get_inline();
+			T* end = p + (cnt < N ? cnt : N);
+			while (p != end)
+				(p++)->~T();
+		}
+
+		// moves n items to uninitialized memory, and destroys the originals
+		static void relocate(T* dest, T* src, size_t n) {
+			if (is_relocatable<T>::value) {
+				memcpy(dest, src, n * sizeof(T));
+				return;
+			}
+			while (n--) {
+#ifdef OOTL_HAS_MOVE
+				new(dest++) T(std::move(*src));
+#else
+				new(dest++) T(*src);
+#endif
+				(src++)->~T();
+			}
+		}
+
+		// hide the assignment operator
+		void operator=(const self& x) { };
+
+		//////////////////////////////////////////////////////////////
+		// fields
+
+		// the other fields exist to help assure alignment
+		union inline_storage {
+			char buffer[N * sizeof(T)];
+			double unused_double;
+			long unused_long;
+			void* unused_pointer;
+		};
+
+		size_t cnt;
+		inline_storage mInline;
+		spill_type* mpSpill;
+	};
+}
+
+#endif
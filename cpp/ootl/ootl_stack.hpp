@@ -4,14 +4,18 @@
 // The file contains the implementation for a persistent stack: a stack class that maintains its memory layout
 // even when more memory needs to be allocated. This means that adding items always has O(1) complexity, instead
 // of O(n) in the worst case as with most common stack implementations. The implementation is based on a vlist which 
-// also provides an average case of O(1) complexity for item indexing. A vlist is a list of buffers, each twice 
-// as big as the previous. The O(1) complexity has to do with the fact that most items occur in the bigger buffers,
-// There is no "begin" and "end" like STL collections, but for iteration over the collection, you can use the "foreach" 
-// member function (or implement your own special iterator)
+// also provides O(1) complexity for item indexing. A vlist is a list of buffers, each twice as big as the 
+// previous, so the buffer holding an item can be computed from the log2 of its index.
+// For iteration over the collection you can use the "foreach" member function, or the random-access 
+// iterators returned by "begin" and "end" (bottom to top) or "rbegin" and "rend" (top to bottom).
 
 #ifndef OOTL_STACK_HPP
 #define OOTL_STACK_HPP
 
+#include <algorithm>
+#include <iterator>
+#include <cstddef>
+
 #include "ootl_vlist.hpp"
 
 namespace ootl 
@@ -34,11 +38,107 @@ namespace ootl
 		return stacker_proc<Stack>(s);
 	}
 
+	/////////////////////////////////////////////////////////
+	// segmented_iterator 
+	//
+	// A random-access iterator over a container made of contiguous segments. Moving
+	// within a segment is only a pointer increment, the container is only consulted 
+	// when crossing into another segment. The container must provide count() and 
+	// get_segment(n, begin, end) which returns a pointer to the n'th item (counting 
+	// from the bottom) and sets begin and end to the bounds of the segment holding it.
+
+	template<typename Container_T, typename Pointer_T>
+	struct segmented_iterator
+	{
+		typedef segmented_iterator self;
+		typedef std::random_access_iterator_tag iterator_category;
+		typedef typename std::iterator_traits<Pointer_T>::value_type value_type;
+		typedef typename std::iterator_traits<Pointer_T>::reference reference;
+		typedef Pointer_T pointer;
+		typedef ptrdiff_t difference_type;
+
+		segmented_iterator() 
+			: mpc(NULL), mn(0), mp(NULL), mpBegin(NULL), mpEnd(NULL) 
+		{ }
+		segmented_iterator(Container_T* c, size_t n) 
+			: mpc(c), mn(n), mp(NULL), mpBegin(NULL), mpEnd(NULL) 
+		{ 
+			load(); 
+		}
+		// allows conversion from an iterator to a const iterator
+		template<typename Container2_T, typename Pointer2_T>
+		segmented_iterator(const segmented_iterator<Container2_T, Pointer2_T>& x)
+			: mpc(x.mpc), mn(x.mn), mp(x.mp), mpBegin(x.mpBegin), mpEnd(x.mpEnd) 
+		{ }
+
+		reference operator*() const { return *mp; }
+		pointer operator->() const { return mp; }
+		reference operator[](difference_type d) const { return *(*this + d); }
+
+		self& operator++() { 
+			++mn; 
+			if (++mp == mpEnd) 
+				load(); 
+			return *this; 
+		}
+		self& operator--() { 
+			--mn; 
+			if (mp == mpBegin) 
+				load(); 
+			else 
+				--mp; 
+			return *this; 
+		}
+		self operator++(int) { self tmp = *this; ++*this; return tmp; }
+		self operator--(int) { self tmp = *this; --*this; return tmp; }
+		self& operator+=(difference_type d) { 
+			mn += d; 
+			difference_type off = (mp - mpBegin) + d;
+			if (mp != NULL && off >= 0 && off < mpEnd - mpBegin)
+				mp += d;
+			else
+				load();
+			return *this; 
+		}
+		self& operator-=(difference_type d) { return *this += -d; }
+		self operator+(difference_type d) const { self tmp = *this; return tmp += d; }
+		self operator-(difference_type d) const { self tmp = *this; return tmp -= d; }
+		friend self operator+(difference_type d, const self& x) { return x + d; }
+		difference_type operator-(const self& x) const { return difference_type(mn - x.mn); }
+
+		bool operator==(const self& x) const { return mn == x.mn; }
+		bool operator!=(const self& x) const { return mn != x.mn; }
+		bool operator<(const self& x) const { return mn < x.mn; }
+		bool operator>(const self& x) const { return mn > x.mn; }
+		bool operator<=(const self& x) const { return mn <= x.mn; }
+		bool operator>=(const self& x) const { return mn >= x.mn; }
+
+		// index of the item, counting from the bottom of the container 
+		size_t index() const { return mn; }
+
+	private:
+
+		template<typename C, typename P> friend struct segmented_iterator;
+
+		void load() {
+			if (mn < mpc->count()) 
+				mp = mpc->get_segment(mn, mpBegin, mpEnd);
+			else 
+				mp = mpBegin = mpEnd = NULL;
+		}
+
+		Container_T* mpc;
+		size_t mn;
+		Pointer_T mp;
+		Pointer_T mpBegin;
+		Pointer_T mpEnd;
+	};
+
 	/////////////////////////////////////////////////////////
 	// ootl::stack implementation
 
-	template < typename T >
-	struct stack : protected vlist<T>
+	template < typename T, typename Policy_T = default_vlist_policy, typename Alloc_T = malloc_vlist_allocator >
+	struct stack : protected vlist<T, Policy_T, Alloc_T>
 	{
 	public:
 		
@@ -47,28 +147,50 @@ namespace ootl
 
 		typedef stack self;
 		typedef T value_type;  
+		typedef vlist<T, Policy_T, Alloc_T> vlist_type;
+		typedef typename vlist_type::buffer buffer;
+		typedef segmented_iterator<self, T*> iterator;
+		typedef segmented_iterator<const self, const T*> const_iterator;
+		typedef std::reverse_iterator<iterator> reverse_iterator;
+		typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
 
 		//////////////////////////////////////////////////////
 		// constructor/destructors 
 
-		stack() : vlist(), cnt(0), ptop(NULL) { 
+		stack() : vlist_type(), cnt(0), ptop(NULL) { 
 			ptop = get_first_buffer()->begin;
 		}
-		stack(const self& x) : vlist(), cnt(0), ptop(NULL) { 
+		stack(const self& x) : vlist_type(), cnt(0), ptop(NULL) { 
 			ptop = get_first_buffer()->begin;
-			x.foreach(stacker(*this));
+			reserve(x.count());
+			append(x);
 		}
-		stack(size_t nsize, const T& x = T()) : vlist(), cnt(0), ptop(NULL) { 
-			initialize(nsize);
+		stack(size_t nsize, const T& x = T()) : vlist_type(), cnt(0), ptop(NULL) { 
 			ptop = get_first_buffer()->begin;
-			while (count() < nsize) {
-			  push(x);
-			}
+			reserve(nsize);
+			push_n(nsize, x);
 		}
+#ifdef OOTL_HAS_MOVE
+		// takes the buffers of x, leaving it empty
+		stack(self&& x) : vlist_type(), cnt(0), ptop(NULL) { 
+			ptop = get_first_buffer()->begin;
+			swap(x);
+		}
+		self& operator=(self&& x) {
+			clear();
+			swap(x);
+			return *this;
+		}
+#endif
+		// constructs a stack from an array, the last item ends up on top
+		stack(const T* first, const T* last) : vlist_type(), cnt(0), ptop(NULL) { 
+			ptop = get_first_buffer()->begin;
+			reserve(last - first);
+			append(first, last - first);
+		}
+		// the buffers are released by the vlist destructor
 		~stack() { 
-			while (count() > 0) {      
-			  pop();
-			}
+			destroy_all();
 		} 
 
 		//////////////////////////////////////////////////////
@@ -103,6 +225,18 @@ namespace ootl
 			push_nocreate();
 			new(ptop - 1) T();
 		}
+#ifdef OOTL_HAS_MOVE
+		void push(T&& x) {
+			push_nocreate();
+			new(ptop - 1) T(std::move(x));
+		}
+		// constructs an item on top of the stack from the arguments
+		template<typename... Args_T>
+		void emplace(Args_T&&... args) {
+			push_nocreate();
+			new(ptop - 1) T(std::forward<Args_T>(args)...);
+		}
+#endif
 		// adds space for an object, without constructing
 		void push_nocreate() {
 			ootl_assert(ptop >= get_last_buffer()->begin);
@@ -149,20 +283,119 @@ namespace ootl
 		}
 		T pull() {
 			ootl_assert(cnt > 0);
+#ifdef OOTL_HAS_MOVE
+			T ret(std::move(top()));
+#else
 			T ret = top();
+#endif
 			pop();
 			return ret;    
 		}
 		void clear() {
-			while (!is_empty()) {
-				pop();
-			}
-			ootl_assert(cnt == 0);
+			destroy_all();
+			clear_nodestroy();
 		}
 		void clear_nodestroy() {
-			while (!is_empty()) {
-				pop_nodestroy();
+			remove_all_but_first();
+			cnt = 0;
+			ptop = get_first_buffer()->begin;
+		}
+		// like clear, but releases the spare buffers as well, so only 
+		// the first buffer is kept for reuse
+		void reset() {
+			clear();
+			release_spares();
+		}
+
+		///////////////////////////////////////////////////
+		// bulk operations, these work a buffer at a time
+
+		// pushes n copies of x
+		void push_n(size_t n, const T& x) {
+			while (n > 0) {
+				size_t k = make_room(n);
+				std::uninitialized_fill_n(ptop, k, x);
+				ptop += k;
+				cnt += k;
+				n -= k;
+			}
+		}
+		// pops n items 
+		void pop_n(size_t n) {
+			ootl_assert(n <= cnt);
+			while (n > 0) {
+				size_t k = ptop - get_last_buffer()->begin;
+				if (k > n) 
+					k = n;
+				destroy(ptop - k, k);
+				ptop -= k;
+				cnt -= k;
+				n -= k;
+				if ((ptop == get_last_buffer()->begin) && (cnt != 0)) {
+					ptop = get_last_buffer()->prev->end;
+					remove_buffer();
+				}
+			}
+		}
+		// pushes n items from an array, the last item ends up on top
+		void append(const T* p, size_t n) {
+			while (n > 0) {
+				size_t k = make_room(n);
+				copy_construct(ptop, p, k);
+				ptop += k;
+				cnt += k;
+				p += k;
+				n -= k;
+			}
+		}
+		// pushes the items of x, from the bottom of x to the top
+		void append(const self& x) {
+			size_t n = x.count();
+			const buffer* cur = x.get_first_buffer();
+			while (n > 0) {
+				size_t k = cur->size < n ? cur->size : n;
+				append(cur->begin, k);
+				n -= k;
+				cur = cur->next;
+			}
+		}
+		// allocates the buffers needed to hold n items 
+		void reserve(size_t n) {
+			vlist_type::reserve(n);
+		}
+		// exchanges the contents of two stacks in constant time
+		void swap(self& x) {
+			vlist_type::swap(x);
+			std::swap(cnt, x.cnt);
+			std::swap(ptop, x.ptop);
+		}
+		// moves all items of x on to the top of this stack, leaving x empty. 
+		// If this stack is empty the buffers of x are simply taken, otherwise the 
+		// items are moved (not copied) a buffer at a time.
+		void splice(self& x) {
+			if (is_empty()) {
+				swap(x);
+				return;
 			}
+			reserve(count() + x.count());
+			size_t n = x.count();
+			buffer* cur = x.get_first_buffer();
+			while (n > 0) {
+				size_t k = cur->size < n ? cur->size : n;
+				T* src = cur->begin;
+				T* end = src + k;
+				while (src != end) {
+					size_t m = make_room(end - src);
+					move_construct(ptop, src, m);
+					ptop += m;
+					cnt += m;
+					src += m;
+				}
+				n -= k;
+				cur = cur->next;
+			}
+			// the moved from items still have to be destroyed
+			x.clear();
 		}
 
 		//////////////////////////////////////////////////////
@@ -171,75 +404,112 @@ namespace ootl
 		template<typename Procedure>
 		void foreach(Procedure& proc) const {
 			const buffer* cur = get_first_buffer();    
-			size_t n = 0;
-			while (n < count()) {
+			size_t n = count();
+			while (n > 0) {
+				size_t k = cur->size < n ? cur->size : n;
+				if (cur->next != NULL)
+					ootl_prefetch(cur->next->begin);
 				T* p = cur->begin;
-				while ((p != cur->end) && (n < count())) {
-					if (p == ptop) return;
+				T* end = p + k;
+				while (p != end) 
 					proc(*p++);
-					++n;
-				}
+				n -= k;
 				cur = cur->next;
 			} 
 		}  
 
+		//////////////////////////////////////////////////////
+		// iterators 
+
+		iterator begin() { return iterator(this, 0); }
+		iterator end() { return iterator(this, count()); }
+		const_iterator begin() const { return const_iterator(this, 0); }
+		const_iterator end() const { return const_iterator(this, count()); }
+		reverse_iterator rbegin() { return reverse_iterator(end()); }
+		reverse_iterator rend() { return reverse_iterator(begin()); }
+		const_reverse_iterator rbegin() const { return const_reverse_iterator(end()); }
+		const_reverse_iterator rend() const { return const_reverse_iterator(begin()); }
+
+		// returns a pointer to the n'th item from the bottom, and the bounds of the 
+		// used part of the buffer holding it. This is used by the iterators. 
+		T* get_segment(size_t n, T*& begin, T*& end) const {
+			ootl_assert(n < cnt);
+			const buffer* p = get_buffer(n);
+			begin = p->begin;
+			end = (p == get_last_buffer()) ? ptop : p->end;
+			if (p->next != NULL)
+				ootl_prefetch(p->next->begin);
+			return p->begin + (n - p->index);
+		}
+		const T* get_segment(size_t n, const T*& begin, const T*& end) const {
+			T* b; 
+			T* e;
+			T* ret = get_segment(n, b, e);
+			begin = b;
+			end = e;
+			return ret;
+		}
+
 		//////////////////////////////////////////////////////
 		// implementation of OOTL Growable concept
 
 		void grow(size_t n = 1, const value_type& x = value_type()) {      
-			while (n--) push(x);
+			push_n(n, x);
 		} 
 
 		//////////////////////////////////////////////////////
 		// implementation of OOTL Shrinkable concept
 
 		void shrink(size_t n = 1) {      
-			while (n--) pop();
+			pop_n(n);
 		}  
 
 		//////////////////////////////////////////////////////
 		// implementation of OOTL Resizable concept  
 
 		void resize(size_t n, const value_type& x = value_type()) {      
-			while (n > count()) push(x);
-			while (n < count()) pop();
+			if (n > count()) 
+				push_n(n - count(), x);
+			else 
+				pop_n(count() - n);
 		}    
 
 		//////////////////////////////////////////////////////
 		// Utility functions
 
-		template<typename T>
+		// copies the items from the bottom of the stack to the top
 		void copy_to_array(T* arr) const
 		{
-			struct copy_proc
-			{
-				T* mp;
-				copy_proc(T* p) : mp(p) { }
-				void operator()(const T& x) { *mp++ = x; }
-			};
-
-			foreach(copy_proc(arr));
+			size_t n = count();
+			const buffer* cur = get_first_buffer();
+			while (n > 0) {
+				size_t k = cur->size < n ? cur->size : n;
+				if (is_trivially_copyable<T>::value)
+					memcpy(arr, cur->begin, k * sizeof(T));
+				else
+					std::copy(cur->begin, cur->begin + k, arr);
+				arr += k;
+				n -= k;
+				cur = cur->next;
+			}
 		}
 
-		// todo: this should be generalized as a zip function 
-		// or I could just use iterators
+		// both stacks have the same buffer layout, so this compares buffer by buffer
 		bool operator==(const self& x) const 
 		{
 			if (count() != x.count()) 
 				return false;
 			const buffer* cur1 = get_first_buffer();    
 			const buffer* cur2 = x.get_first_buffer();    
-			size_t n = 0;
-			while (n < count()) {
-				T* p1 = cur1->begin;
-				T* p2 = cur2->begin;
-				while ((p1 != cur1->end) && (p2 != cur2->end) && (n < count())) {
-					if (!(*p1 == *p2)) 
-						return false;
-					n++;
-				}
-				if (p1 == cur1->end) cur1 = cur1->next;
-				if (p2 == cur2->end) cur2 = cur2->next;
+			size_t n = count();
+			while (n > 0) {
+				ootl_assert(cur1->size == cur2->size);
+				size_t k = cur1->size < n ? cur1->size : n;
+				if (!std::equal(cur1->begin, cur1->begin + k, cur2->begin))
+					return false;
+				n -= k;
+				cur1 = cur1->next;
+				cur2 = cur2->next;
 			} 
 			return true;
 		}
@@ -249,6 +519,56 @@ namespace ootl
 
 	private:
 
+		// makes sure there is room on top of the stack, and returns how many 
+		// of the n items can be placed contiguously at ptop
+		size_t make_room(size_t n) {
+			if (ptop == get_last_buffer()->end) {
+				add_buffer();
+				ptop = get_last_buffer()->begin;
+			}
+			size_t k = get_last_buffer()->end - ptop;
+			return k < n ? k : n;
+		}
+
+		static void copy_construct(T* dest, const T* src, size_t n) {
+			if (is_trivially_copyable<T>::value)
+				memcpy(dest, src, n * sizeof(T));
+			else
+				std::uninitialized_copy(src, src + n, dest);
+		}
+
+		static void move_construct(T* dest, T* src, size_t n) {
+			if (is_trivially_copyable<T>::value)
+				memcpy(dest, src, n * sizeof(T));
+			else
+				while (n--) 
+#ifdef OOTL_HAS_MOVE
+					new(dest++) T(std::move(*src++));
+#else
+					new(dest++) T(*src++);
+#endif
+		}
+
+		static void destroy(T* p, size_t n) {
+			if (!is_trivially_destructible<T>::value)
+				while (n--) 
+					(p++)->~T();
+		}
+
+		// destroys every item a buffer at a time, but doesn't change the count
+		void destroy_all() {
+			if (is_trivially_destructible<T>::value)
+				return;
+			size_t n = count();
+			buffer* cur = get_first_buffer();
+			while (n > 0) {
+				size_t k = cur->size < n ? cur->size : n;
+				destroy(cur->begin, k);
+				n -= k;
+				cur = cur->next;
+			}
+		}
+
 		// hide the assignment operator
 		void operator=(const self& x) { };
 
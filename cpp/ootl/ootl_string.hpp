@@ -28,88 +28,180 @@ namespace ootl
 		const char* m;
 	};
 
+	// A string stores its characters contiguously, followed by a zero, so c_str() is O(1).
+	// Short strings are stored inside of the object itself. A very long string that is
+	// still growing becomes a rope: its characters are appended to an ootl::stack, which
+	// never moves what it already holds, instead of reallocating and copying the whole 
+	// string each time it grows. The rope is copied into a contiguous buffer again the 
+	// next time c_str() is called.
+	//
+	// Note: unlike ootl::stack, string[0] is the first character.
 	struct string 
 	{  
-		struct dyn_buffer
-		{
-			dyn_buffer(const dyn_buffer& x)
-			{
-				size_t n = strlen(x.m);
-				m = new char[n];
-				strcpy_s(m, n, x.m);
-			}
-			dyn_buffer(const string& s) 
-			{
-				size_t n = s.count();
-				m = new char[n + 1];
-				s.copy_to_array(m);
-				m[n] = '\0';
-			}
-			~dyn_buffer()
-			{
-				delete[] m;
-			}
-			operator const char*() const 
-			{ 
-				return m; 
-			}
-		private:
-			dyn_buffer() { }
-			char* m;
-		};
-
 		typedef string self;
+
+		// the number of characters stored in the object itself
+		static const size_t inline_capacity = 15;
+
+		// a string that needs to grow past this size becomes a rope
+		static const size_t rope_threshold = 1 << 20;
 	  
+		string() {
+			initialize();
+		}
 		string(const char* x) {
-			assign(x);
+			initialize();
+			concat(x);
+		}
+		string(const char* x, size_t n) {
+			initialize();
+			append(x, n);
+		}
+		string(const self& x) {
+			initialize();
+			concat(x);
+		}
+#ifdef OOTL_HAS_MOVE
+		string(self&& x) {
+			initialize();
+			take(x);
+		}
+		self& operator=(self&& x) {
+			if (&x != this) {
+				release();
+				initialize();
+				take(x);
+			}
+			return *this;
 		}
-		string(const self& x) : m(x.m) {
+#endif
+		~string() {
+			release();
 		}
 		self& assign(const char* x) {
 			clear();
 			return concat(x);
 		}  
 		self& assign(const self& x) {
+			if (&x == this)
+				return *this;
 			clear();
 			return concat(x);
 		}  
 		char& operator[](int n) {
-			return m[n];
+			ootl_assert(n >= 0 && (size_t)n < mnCount);
+			if (mpRope != NULL)
+				return (*mpRope)[mnCount - n - 1];
+			return mpData[n];
 		}
 		const char& operator[](int n) const {
-			return m[n];
+			return const_cast<self*>(this)->operator[](n);
 		}
 		size_t count() const {
-			return m.count();
+			return mnCount;
+		}
+		bool is_empty() const {
+			return mnCount == 0;
 		}
 		template<typename T>
 		self& concat(const T& x) {
-			x.foreach(stacker(*this));  
+			pusher p(*this);
+			x.foreach(p);  
+			return *this;
+		}
+		self& concat(const self& x) {
+			if (&x == this) {
+				self tmp(x);
+				return concat(tmp);
+			}
+			if (x.mpRope == NULL)
+				return append(x.mpData, x.mnCount);
+			if (mpRope != NULL || !grow(x.mnCount)) {
+				mpRope->append(*x.mpRope);
+			}
+			else {
+				x.mpRope->copy_to_array(mpData + mnCount);
+				mpData[mnCount + x.mnCount] = '\0';
+			}
+			mnCount += x.mnCount;
 			return *this;
 		}
 		self& concat(const char* x) {  
 			if (x == NULL) return *this;
-			while (*x != 0) {
-				m.push(*x++);
+			return append(x, strlen(x));
+		}
+		// appends n characters from x, which may point into this string
+		self& append(const char* x, size_t n) {
+			if (n == 0) 
+				return *this;
+			if (mpRope != NULL) {
+				mpRope->append(x, n);
+			}
+			else if (mnCount + n <= mnCapacity) {
+				memmove(mpData + mnCount, x, n);
+				mpData[mnCount + n] = '\0';
 			}
+			else {
+				// x is copied before the old buffer is released
+				char* old = mpData;
+				if (grow_keep(n)) {
+					memcpy(mpData + mnCount, x, n);
+					mpData[mnCount + n] = '\0';
+				}
+				else {
+					mpRope->append(x, n);
+				}
+				if (old != mInline)
+					free(old);
+			}
+			mnCount += n;
 			return *this;
 		}
 		void push(char x) {
-			m.push(x);
+			if (mpRope != NULL) {
+				mpRope->push(x);
+				++mnCount;
+			}
+			else if (mnCount < mnCapacity) {
+				mpData[mnCount++] = x;
+				mpData[mnCount] = '\0';
+			}
+			else {
+				append(&x, 1);
+			}
 		}  
 		char pop() {
-			return m.pull();
+			ootl_assert(mnCount > 0);
+			--mnCount;
+			if (mpRope != NULL)
+				return mpRope->pull();
+			char ret = mpData[mnCount];
+			mpData[mnCount] = '\0';
+			return ret;
 		}
+		// removes all characters, and releases any memory
 		void clear() {
-			m.clear();
+			release();
+			initialize();
+		}
+		// makes room for a total of n characters in a contiguous buffer
+		void reserve(size_t n) {
+			flatten();
+			if (n > mnCapacity)
+				reallocate(n);
 		}
 		template<typename Proc>
 		void foreach(Proc& x) {
-			m.foreach(x);
+			if (mpRope != NULL) {
+				mpRope->foreach(x);
+				return;
+			}
+			for (size_t i = 0; i < mnCount; ++i)
+				x(mpData[i]);
 		}
 		template<typename Proc>
 		void foreach(Proc& x) const {
-			m.foreach(x);
+			const_cast<self*>(this)->foreach(x);
 		}
 		self& operator=(const self& x) {
 			return assign(x);
@@ -123,22 +215,165 @@ namespace ootl
 		self& operator+=(const char* x) {
 			return concat(x);
 		}
-		const self& operator+(const self& x) const {
-			return self(*this).concat(x);
+		self operator+(const self& x) const {
+			self ret;
+			ret.reserve(mnCount + x.mnCount);
+			ret.concat(*this);
+			ret.concat(x);
+			return ret;
+		}
+		self operator+(const char* x) const {
+			self ret(*this);
+			ret.concat(x);
+			return ret;
 		}
-		const self& operator+(const char* x) const {
-			return self(*this).concat(x);
+		bool operator==(const self& x) const {
+			if (mnCount != x.mnCount)
+				return false;
+			return memcmp(c_str(), x.c_str(), mnCount) == 0;
+		}
+		bool operator==(const char* x) const {
+			return strcmp(c_str(), x) == 0 && strlen(x) == mnCount;
 		}
 		void copy_to_array(char* x) const 
 		{
-			m.copy_to_array(x);
+			if (mpRope != NULL)
+				mpRope->copy_to_array(x);
+			else
+				memcpy(x, mpData, mnCount);
+		}
+		// a rope is first copied into a contiguous buffer
+		const char* c_str() const
+		{
+			const_cast<self*>(this)->flatten();
+			return mpData;
 		}
-		dyn_buffer to_char_ptr() const
+		const char* to_char_ptr() const
 		{
-			return dyn_buffer(*this);
+			return c_str();
+		}
+		// exchanges the contents of two strings
+		void swap(self& x) {
+			self tmp;
+			tmp.take(*this);
+			take(x);
+			x.take(tmp);
 		}
+		bool is_rope() const {
+			return mpRope != NULL;
+		}
+
 	private:    
-		stack<char> m;
+
+		struct pusher 
+		{
+			pusher(self& x) : s(x) { }
+			void operator()(char c) { s.push(c); }
+			self& s;
+		};
+
+		void initialize() {
+			mInline[0] = '\0';
+			mpData = mInline;
+			mnCount = 0;
+			mnCapacity = inline_capacity;
+			mpRope = NULL;
+		}
+
+		void release() {
+			if (mpData != mInline)
+				free(mpData);
+			delete mpRope;
+		}
+
+		// moves the contents of x into this string, which must be empty, leaving x empty
+		void take(self& x) {
+			ootl_assert(mnCount == 0 && mpData == mInline && mpRope == NULL);
+			if (x.mpData == x.mInline) 
+				memcpy(mInline, x.mInline, x.mnCount + 1);
+			else if (x.mpData != NULL) {
+				mpData = x.mpData;
+				mnCapacity = x.mnCapacity;
+			}
+			else {
+				mpData = NULL;
+				mnCapacity = 0;
+			}
+			mnCount = x.mnCount;
+			mpRope = x.mpRope;
+			x.initialize();
+		}
+
+		// a new buffer with a capacity of n characters
+		static char* allocate(size_t n) {
+			char* ret = static_cast<char*>(malloc(n + 1));
+			if (ret == NULL)
+				throw std::bad_alloc();
+			return ret;
+		}
+
+		// moves the characters to a new buffer with a capacity of n characters
+		void reallocate(size_t n) {
+			char* p = allocate(n);
+			memcpy(p, mpData, mnCount + 1);
+			if (mpData != mInline)
+				free(mpData);
+			mpData = p;
+			mnCapacity = n;
+		}
+
+		// makes room for n more characters. Either the string gets a bigger contiguous
+		// buffer and true is returned, or the string becomes a rope and false is returned.
+		bool grow(size_t n) {
+			char* old = mpData;
+			bool ret = grow_keep(n);
+			if (old != mInline && old != mpData)
+				free(old);
+			return ret;
+		}
+
+		// like grow, but the caller releases the previous buffer (unless it is inline)
+		bool grow_keep(size_t n) {
+			size_t nNeeded = mnCount + n;
+			if (nNeeded > rope_threshold) {
+				mpRope = new stack<char>();
+				mpRope->append(mpData, mnCount);
+				mpData = NULL;
+				mnCapacity = 0;
+				return false;
+			}
+			size_t nCapacity = mnCapacity * 2;
+			if (nCapacity < nNeeded)
+				nCapacity = nNeeded;
+			char* p = allocate(nCapacity);
+			memcpy(p, mpData, mnCount);
+			mpData = p;
+			mnCapacity = nCapacity;
+			return true;
+		}
+
+		// copies a rope into a contiguous buffer
+		void flatten() {
+			if (mpRope == NULL)
+				return;
+			char* p = allocate(mnCount);
+			mpRope->copy_to_array(p);
+			p[mnCount] = '\0';
+			delete mpRope;
+			mpRope = NULL;
+			mpData = p;
+			mnCapacity = mnCount;
+		}
+
+		//////////////////////////////////////////////////////
+		// fields
+
+		// points to mInline, a buffer from malloc, or NULL for a rope
+		char* mpData;
+		size_t mnCount;
+		size_t mnCapacity;
+		stack<char>* mpRope;
+		char mInline[inline_capacity + 1];
 	};
 
 }
@@ -0,0 +1,192 @@
+// Public Domain by Christopher Diggins
+// http://www.ootl.org
+//
+// Symbols are interned strings: each distinct string is stored once in a symbol_table and
+// is identified by an integer. Comparing or hashing two symbols only looks at their ids.
+// The text of a symbol never moves and is kept until the program exits.
+//
+// The global symbol table is not synchronized, symbols should only be created from one
+// thread at a time.
+
+#ifndef OOTL_SYMBOL_HPP
+#define OOTL_SYMBOL_HPP
+
+#include "ootl_hash.hpp"
+
+namespace ootl
+{
+	struct symbol_table
+	{
+		// texts shorter than this are packed together into chunks of this size
+		static const size_t chunk_size = 4096;
+
+		symbol_table() : mpChunk(NULL), mnChunkLeft(0)
+		{
+			// the empty string is always symbol 0
+			intern("", 0);
+		}
+
+		~symbol_table()
+		{
+			while (!mChunks.is_empty())
+				free(mChunks.pull());
+		}
+
+		// returns the id of the string, adding it to the table if needed
+		size_t intern(const char* x, size_t n)
+		{
+			key k;
+			k.text = x;
+			k.count = n;
+			size_t* p = mIds.find(k);
+			if (p != NULL)
+				return *p;
+			entry e;
+			e.text = store(x, n);
+			e.count = n;
+			size_t ret = mEntries.count();
+			mEntries.push(e);
+			k.text = e.text;
+			mIds.add(k, ret);
+			return ret;
+		}
+
+		// the id of the string, or -1 if it was never interned
+		size_t find(const char* x, size_t n)
+		{
+			key k;
+			k.text = x;
+			k.count = n;
+			size_t* p = mIds.find(k);
+			return p == NULL ? size_t(-1) : *p;
+		}
+
+		const char* text(size_t id) const
+		{
+			return get_entry(id).text;
+		}
+
+		size_t length(size_t id) const
+		{
+			return get_entry(id).count;
+		}
+
+		// the number of distinct symbols
+		size_t count() const
+		{
+			return mEntries.count();
+		}
+
+	private:
+
+		struct entry
+		{
+			const char* text;
+			size_t count;
+		};
+
+		struct key
+		{
+			const char* text;
+			size_t count;
+			bool operator==(const key& x) const
+			{
+				return count == x.count && memcmp(text, x.text, count) == 0;
+			}
+		};
+
+		struct key_hasher
+		{
+			u8 operator()(const key& x) const
+			{
+				return wy_hash(x.text, x.count);
+			}
+		};
+
+		const entry& get_entry(size_t id) const
+		{
+			ootl_assert(id < mEntries.count());
+			return mEntries.begin()[id];
+		}
+
+		// copies the text, followed by a zero, to memory that is never moved
+		const char* store(const char* x, size_t n)
+		{
+			char* ret;
+			if (n + 1 > chunk_size / 4)
+			{
+				ret = allocate(n + 1);
+			}
+			else
+			{
+				if (n + 1 > mnChunkLeft)
+				{
+					mpChunk = allocate(chunk_size);
+					mnChunkLeft = chunk_size;
+				}
+				ret = mpChunk;
+				mpChunk += n + 1;
+				mnChunkLeft -= n + 1;
+			}
+			memcpy(ret, x, n);
+			ret[n] = '\0';
+			return ret;
+		}
+
+		char* allocate(size_t n)
+		{
+			char* ret = static_cast<char*>(malloc(n));
+			if (ret == NULL)
+				throw std::bad_alloc();
+			mChunks.push(ret);
+			return ret;
+		}
+
+		// hide the copy constructor and assignment operator
+		symbol_table(const symbol_table&);
+		void operator=(const symbol_table&);
+
+		flat_hash_map<key, size_t, key_hasher> mIds;
+		stack<entry> mEntries;
+		stack<char*> mChunks;
+		char* mpChunk;
+		size_t mnChunkLeft;
+	};
+
+	// the table used by ootl::symbol
+	inline symbol_table& global_symbols()
+	{
+		static symbol_table table;
+		return table;
+	}
+
+	struct symbol
+	{
+		// the empty string
+		symbol() : mnId(0) { }
+		explicit symbol(const char* x) : mnId(global_symbols().intern(x, strlen(x))) { }
+		symbol(const char* x, size_t n) : mnId(global_symbols().intern(x, n)) { }
+
+		size_t id() const { return mnId; }
+		const char* c_str() const { return global_symbols().text(mnId); }
+		size_t count() const { return global_symbols().length(mnId); }
+		bool is_empty() const { return mnId == 0; }
+
+		bool operator==(const symbol& x) const { return mnId == x.mnId; }
+		bool operator!=(const symbol& x) const { return mnId != x.mnId; }
+		// orders symbols by when they were first interned, not alphabetically
+		bool operator<(const symbol& x) const { return mnId < x.mnId; }
+
+	private:
+		size_t mnId;
+	};
+
+	template<>
+	struct hasher<symbol> {
+	  u8 operator()(const symbol& x) const {
+		return hash_mix(x.id());
+	  }
+	};
+}
+
+#endif
@@ -0,0 +1,85 @@
+// Public Domain by Christopher Diggins
+// http://www.ootl.org
+//
+// Compile-time type properties used by the containers to choose faster code paths.
+// They rely on compiler intrinsics; on unknown compilers every type is assumed
+// to be non-trivial, which is always safe.
+
+#ifndef OOTL_TYPE_TRAITS_HPP
+#define OOTL_TYPE_TRAITS_HPP
+
+#if defined(_MSC_VER) || defined(__GNUC__)
+#define OOTL_HAS_TYPE_INTRINSICS
+#endif
+
+// the alignment of a type, or a multiple of it
+#ifdef OOTL_HAS_TYPE_INTRINSICS
+#define OOTL_ALIGNOF(T) __alignof(T)
+#else
+#define OOTL_ALIGNOF(T) sizeof(T)
+#endif
+
+// rvalue references and variadic templates (C++11) are used for move support
+#if (__cplusplus >= 201103L) || (defined(_MSC_VER) && _MSC_VER >= 1800)
+#define OOTL_HAS_MOVE
+#include <utility>
+#endif
+
+namespace ootl
+{
+	// true if a T can be copied using memcpy
+	template<typename T>
+	struct is_trivially_copyable
+	{
+#ifdef OOTL_HAS_TYPE_INTRINSICS
+		static const bool value = __has_trivial_copy(T) && __has_trivial_assign(T);
+#else
+		static const bool value = false;
+#endif
+	};
+
+	// true if the destructor of T does nothing
+	template<typename T>
+	struct is_trivially_destructible
+	{
+#ifdef OOTL_HAS_TYPE_INTRINSICS
+		static const bool value = __has_trivial_destructor(T);
+#else
+		static const bool value = false;
+#endif
+	};
+
+	// true if a T can be moved to another address using memcpy, without calling its
+	// copy constructor and destructor. Most types can be, except for those that point 
+	// into themselves, but this is only known for trivial types. Other types can be 
+	// marked with OOTL_RELOCATABLE (at global scope).
+	template<typename T>
+	struct is_relocatable
+	{
+		static const bool value = is_trivially_copyable<T>::value;
+	};
+}
+
+// Defines has_member_NAME<T>, which is true if the class T has a member called NAME, 
+// static or not. A class derived from both T and a class with a NAME member makes 
+// the name ambiguous exactly when T has it, and taking its address then fails. 
+#define OOTL_DEFINE_HAS_MEMBER(NAME) \
+	template<typename T> \
+	struct has_member_##NAME \
+	{ \
+		struct fallback { int NAME; }; \
+		struct derived : T, fallback { }; \
+		template<typename U, U> struct check; \
+		typedef char yes[1]; \
+		typedef char no[2]; \
+		template<typename U> static no& test(check<int fallback::*, &U::NAME>*); \
+		template<typename U> static yes& test(...); \
+		static const bool value = sizeof(test<derived>(0)) == sizeof(yes); \
+	};
+
+#define OOTL_RELOCATABLE(T) \
+	namespace ootl { \
+		template<> struct is_relocatable<T> { static const bool value = true; }; \
+	}
+
+#endif
@@ -5,7 +5,15 @@
 #define OOTL_VLIST_HPP
 
 #include <cstdlib>
+#include <cstring>
 #include <memory>
+#include <algorithm>
+
+#include "ootl_type_traits.hpp"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 #ifdef DEBUG
 void ootl_assert(bool b) {
@@ -16,16 +24,172 @@ void ootl_assert(bool b) {
 #define ootl_assert(TOKEN) ;
 #endif
 
+#ifdef _MSC_VER
+#define OOTL_THREAD_LOCAL __declspec(thread)
+#else
+#define OOTL_THREAD_LOCAL __thread
+#endif
+
+// hints that memory will soon be read
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#include <xmmintrin.h>
+#define ootl_prefetch(PTR) _mm_prefetch((const char*)(PTR), _MM_HINT_T0)
+#elif defined(__GNUC__)
+#define ootl_prefetch(PTR) __builtin_prefetch(PTR)
+#else
+#define ootl_prefetch(PTR) ;
+#endif
 
 namespace ootl 
 {
+	// returns the index of the highest set bit, n must be non-zero
+	inline size_t floor_log2(size_t n)
+	{
+		ootl_assert(n != 0);
+#if defined(_MSC_VER) && defined(_WIN64)
+		unsigned long r;
+		_BitScanReverse64(&r, n);
+		return r;
+#elif defined(_MSC_VER)
+		unsigned long r;
+		_BitScanReverse(&r, n);
+		return r;
+#elif defined(__GNUC__)
+		return sizeof(unsigned long long) * 8 - 1 - __builtin_clzll(n);
+#else
+		size_t r = 0;
+		while (n >>= 1) 
+			++r;
+		return r;
+#endif
+	}
+
+	// returns the index of the lowest power of two greater or equal to n
+	inline size_t ceil_log2(size_t n)
+	{
+		return n <= 1 ? 0 : floor_log2(n - 1) + 1;
+	}
+
+	// The default buffer allocator simply uses malloc and free.
+	struct malloc_vlist_allocator
+	{
+		static void* allocate(size_t nbytes) 
+		{ 
+			void* ret = malloc(nbytes);
+			if (ret == NULL)
+				throw std::bad_alloc();
+			return ret;
+		}
+		static void deallocate(void* p, size_t nbytes) 
+		{ 
+			free(p); 
+		}
+	};
+
+	// This allocator keeps freed buffers in thread local free lists, one per 
+	// power of two size class. Since buffers are always initial_size() * 2^k 
+	// items, most buffer sizes fall exactly into a class and can be shared 
+	// between vlists of different types with the same item size. 
+	// Note: blocks left in a free list when a thread exits are not released.
+	struct pooled_vlist_allocator
+	{
+		// classes above this size (1MB) go straight to malloc
+		static const size_t max_pooled_class = 20;
+
+		// the most free blocks kept for each size class
+		static const size_t max_blocks_per_class = 8;
+
+		struct free_lists
+		{
+			void* heads[max_pooled_class + 1];
+			size_t counts[max_pooled_class + 1];
+		};
+
+		static free_lists& get_free_lists()
+		{
+			static OOTL_THREAD_LOCAL free_lists lists;
+			return lists;
+		}
+
+		static void* allocate(size_t nbytes) 
+		{
+			size_t n = ceil_log2(nbytes);
+			if (n > max_pooled_class)
+				return malloc_vlist_allocator::allocate(nbytes);
+			free_lists& lists = get_free_lists();
+			void* ret = lists.heads[n];
+			if (ret == NULL)
+				return malloc_vlist_allocator::allocate(size_t(1) << n);
+			lists.heads[n] = *(void**)ret;
+			--lists.counts[n];
+			return ret;
+		}
+
+		static void deallocate(void* p, size_t nbytes) 
+		{
+			size_t n = ceil_log2(nbytes);
+			free_lists& lists = get_free_lists();
+			if (n > max_pooled_class || lists.counts[n] >= max_blocks_per_class)
+			{
+				free(p);
+				return;
+			}
+			ootl_assert(nbytes >= sizeof(void*));
+			*(void**)p = lists.heads[n];
+			lists.heads[n] = p;
+			++lists.counts[n];
+		}
+	};
+
+	// A policy must provide initial_size() and new_size(). The other members are 
+	// optional, see vlist_policy_traits for their defaults. 
+	// If geometric is true then new_size(x) must return x * 2 and initial_size() 
+	// must be a power of two. This lets a vlist locate the buffer holding an index
+	// in constant time. 
+	// spare_buffers() is the number of removed buffers that are kept past the 
+	// last buffer for reuse, so that a stack hovering around a buffer boundary 
+	// doesn't allocate and free a buffer every time it crosses it.
+	// If zero_fill is true new buffers are cleared before use. A stack never 
+	// reads an item it hasn't constructed so this is usually unnecessary.
 	struct default_vlist_policy
 	{
 		static size_t initial_size() { return 8; }
 		static size_t new_size(size_t old_size) { return old_size * 2; }
+		static size_t spare_buffers() { return 1; }
+		static const bool geometric = true;
+		static const bool zero_fill = false;
 	};
 
-	template<typename T, typename Policy_T = default_vlist_policy>
+	OOTL_DEFINE_HAS_MEMBER(geometric)
+	OOTL_DEFINE_HAS_MEMBER(zero_fill)
+	OOTL_DEFINE_HAS_MEMBER(spare_buffers)
+
+	template<typename Policy_T, bool B = has_member_geometric<Policy_T>::value>
+	struct policy_geometric { static const bool value = Policy_T::geometric; };
+	template<typename Policy_T>
+	struct policy_geometric<Policy_T, false> { static const bool value = false; };
+
+	template<typename Policy_T, bool B = has_member_zero_fill<Policy_T>::value>
+	struct policy_zero_fill { static const bool value = Policy_T::zero_fill; };
+	template<typename Policy_T>
+	struct policy_zero_fill<Policy_T, false> { static const bool value = false; };
+
+	template<typename Policy_T, bool B = has_member_spare_buffers<Policy_T>::value>
+	struct policy_spare_buffers { static size_t get() { return Policy_T::spare_buffers(); } };
+	template<typename Policy_T>
+	struct policy_spare_buffers<Policy_T, false> { static size_t get() { return 0; } };
+
+	// The optional members of a policy, or their defaults when the policy doesn't 
+	// declare them: not geometric, no zero fill and no spare buffers. 
+	template<typename Policy_T>
+	struct vlist_policy_traits
+	{
+		static const bool geometric = policy_geometric<Policy_T>::value;
+		static const bool zero_fill = policy_zero_fill<Policy_T>::value;
+		static size_t spare_buffers() { return policy_spare_buffers<Policy_T>::get(); }
+	};
+
+	template<typename T, typename Policy_T = default_vlist_policy, typename Alloc_T = malloc_vlist_allocator>
 	struct vlist
 	{
 		vlist() 
@@ -33,11 +197,36 @@ namespace ootl
 			mCap = Policy_T::initial_size();
 			mFirst = new buffer(mCap);
 			mLast = mFirst;
+			mnBuffers = 1;
+			mnSpares = 0;
+			mDir = NULL;
+			mnDirCap = 0;
 		}
+#ifdef OOTL_HAS_MOVE
+		// a moved from vlist is left with a single buffer
+		vlist(vlist&& x)
+		{
+			mCap = Policy_T::initial_size();
+			mFirst = new buffer(mCap);
+			mLast = mFirst;
+			mnBuffers = 1;
+			mnSpares = 0;
+			mDir = NULL;
+			mnDirCap = 0;
+			swap(x);
+		}
+#endif
 		~vlist()
 		{
-			while (mLast != NULL)
-				remove_buffer();
+			// this also deletes the spare buffers
+			buffer* cur = mFirst;
+			while (cur != NULL)
+			{
+				buffer* tmp = cur;
+				cur = cur->next;
+				delete(tmp);
+			}
+			free(mDir);
 		}
 
 		//////////////////////////////////////////////////////
@@ -56,16 +245,17 @@ namespace ootl
 				index(i), 
 				prev(NULL), 
 				next(NULL),
-				begin((T*)malloc(n * sizeof(T))),
+				begin((T*)Alloc_T::allocate(n * sizeof(T))),
 				end(begin + n)
 			{ 
 				ootl_assert(n >= Policy_T::initial_size());				
-				memset(begin, 0, n * sizeof(T));
+				if (vlist_policy_traits<Policy_T>::zero_fill)
+					memset(begin, 0, n * sizeof(T));
 			}
 
 			~buffer()
 			{
-				free(begin);
+				Alloc_T::deallocate(begin, size * sizeof(T));
 			}
 
 			size_t index; 
@@ -95,13 +285,21 @@ namespace ootl
 		{
 			return mLast;
 		}
-		T* get_pointer(size_t n) 
+		// returns the buffer holding the item at index n
+		buffer* get_buffer(size_t n) 
 		{
 			ootl_assert(n >= 0);
 			ootl_assert(n < mCap);
 			if (n >= mLast->index) 
 			{ 
-				return mLast->begin + (n - mLast->index); 
+				return mLast; 
+			}
+			if (vlist_policy_traits<Policy_T>::geometric)
+			{
+				// buffer k starts at index initial_size() * (2^k - 1)
+				buffer* p = mDir[floor_log2(n / Policy_T::initial_size() + 1)];
+				ootl_assert(n >= p->index && n < p->index + p->size);
+				return p;
 			}
 			buffer* curr = mLast->prev;    
 			ootl_assert(curr != NULL);
@@ -110,7 +308,16 @@ namespace ootl
 				curr = curr->prev;    
 				ootl_assert(curr != NULL);
 			}
-			return curr->begin + (n - curr->index);
+			return curr;
+		}
+		const buffer* get_buffer(size_t n) const 
+		{
+			return const_cast<self*>(this)->get_buffer(n);
+		}
+		T* get_pointer(size_t n) 
+		{
+			buffer* p = get_buffer(n);
+			return p->begin + (n - p->index);
 		}
 		const T* get_pointer(size_t n) const 
 		{
@@ -125,6 +332,20 @@ namespace ootl
 			if (mLast == NULL) 
 			{
 				mLast = mFirst;
+				mnBuffers = 1;
+			}
+			else if (mLast->next != NULL)
+			{
+				// reuse a spare buffer
+				ootl_assert(mnSpares > 0);
+				--mnSpares;
+				mLast = mLast->next;
+				mCap += mLast->size;
+				if (vlist_policy_traits<Policy_T>::geometric)
+					add_to_directory(mLast);
+				++mnBuffers;
+				if (vlist_policy_traits<Policy_T>::zero_fill)
+					memset(mLast->begin, 0, mLast->size * sizeof(T));
 			}
 			else 
 			{
@@ -135,14 +356,19 @@ namespace ootl
 		{
 			ootl_assert(mLast != NULL);
 			ootl_assert(x != NULL);
+			release_spares();
 			x->prev = mLast;
 			mLast->next = x;
 			mLast = x;
 			mCap += mLast->size;
+			if (vlist_policy_traits<Policy_T>::geometric)
+				add_to_directory(x);
+			++mnBuffers;
 		}    
 		void remove_buffer() 
 		{
 			ootl_assert(mLast != NULL);
+			--mnBuffers;
 			if (mLast == mFirst)
 			{
 				mLast = NULL;
@@ -153,13 +379,120 @@ namespace ootl
 				mCap -= mLast->size;
 				mLast = mLast->prev;
 				ootl_assert(mLast != NULL);
-				mLast->next = NULL;
-				delete(tmp);
+				if (mnSpares < vlist_policy_traits<Policy_T>::spare_buffers())
+				{
+					// keep the buffer linked past the end 
+					++mnSpares;
+				}
+				else 
+				{
+					// the new spare is smaller, so the last spare is dropped
+					if (tmp->next != NULL)
+					{
+						buffer* last = tmp->next;
+						while (last->next != NULL) 
+							last = last->next;
+						last->prev->next = NULL;
+						delete(last);
+					}
+					else
+					{
+						mLast->next = NULL;
+						delete(tmp);
+					}
+				}
 			}
 		}    
+		// exchanges all buffers with another vlist in constant time
+		void swap(self& x)
+		{
+			std::swap(mFirst, x.mFirst);
+			std::swap(mLast, x.mLast);
+			std::swap(mCap, x.mCap);
+			std::swap(mnBuffers, x.mnBuffers);
+			std::swap(mnSpares, x.mnSpares);
+			std::swap(mDir, x.mDir);
+			std::swap(mnDirCap, x.mnDirCap);
+		}
+		// makes sure that the buffers up to a total capacity of n exist, by
+		// adding spare buffers past the last buffer
+		void reserve(size_t n)
+		{
+			ootl_assert(mLast != NULL);
+			buffer* last = mLast;
+			size_t nCap = mCap;
+			while (last->next != NULL)
+			{
+				last = last->next;
+				nCap += last->size;
+			}
+			while (nCap < n)
+			{
+				buffer* tmp = new buffer(Policy_T::new_size(last->size), nCap);
+				tmp->prev = last;
+				last->next = tmp;
+				last = tmp;
+				nCap += tmp->size;
+				++mnSpares;
+			}
+		}
+		void release_spares()
+		{
+			buffer* cur = mLast->next;
+			mLast->next = NULL;
+			while (cur != NULL)
+			{
+				buffer* tmp = cur;
+				cur = cur->next;
+				delete(tmp);
+			}
+			mnSpares = 0;
+		}
+		// removes all buffers except the first one at once. The nearest 
+		// buffers are kept as spares, as if they were removed one by one.
+		void remove_all_but_first()
+		{
+			ootl_assert(mLast != NULL);
+			mLast = mFirst;
+			mCap = mFirst->size;
+			mnBuffers = 1;
+			mnSpares = 0;
+			buffer* last = mFirst;
+			while (last->next != NULL && mnSpares < vlist_policy_traits<Policy_T>::spare_buffers())
+			{
+				last = last->next;
+				++mnSpares;
+			}
+			buffer* cur = last->next;
+			last->next = NULL;
+			while (cur != NULL)
+			{
+				buffer* tmp = cur;
+				cur = cur->next;
+				delete(tmp);
+			}
+		}
 
 	private:
 
+		// records a new buffer in the directory used by get_pointer(). The directory 
+		// is only allocated once a second buffer is added, and it only ever has 
+		// to hold about log2(max_size) entries. 
+		void add_to_directory(buffer* x)
+		{
+			if (mnBuffers >= mnDirCap)
+			{
+				size_t nCap = mnDirCap == 0 ? 8 : mnDirCap * 2;
+				buffer** tmp = (buffer**)realloc(mDir, nCap * sizeof(buffer*));
+				if (tmp == NULL) 
+					throw std::bad_alloc();
+				mDir = tmp;
+				mnDirCap = nCap;
+			}
+			mDir[0] = mFirst;
+			mDir[mnBuffers] = x;
+		}
+
 		// hide the copy constructor 
 		vlist(const self& x) { };
 
@@ -172,6 +505,10 @@ namespace ootl
 		buffer* mFirst; 
 		buffer* mLast;
 		size_t mCap;
+		size_t mnBuffers;
+		size_t mnSpares;
+		buffer** mDir;
+		size_t mnDirCap;
 	};
 }
 